@@ -0,0 +1,641 @@
+#pragma once
+
+// Machine-readable benchmark results shared by all tools.
+//
+// Every tool adds its measurements to a BenchResults and calls
+// finish_results() at the end, which
+//   --json=FILE        writes the results with host metadata as JSON
+//   --csv=FILE         writes them as CSV
+//   --compare=FILE     compares them with a baseline written by --json and
+//                      fails if a result got significantly worse
+//   --threshold=PCT    smallest change reported as a regression (default 5)
+// The free-form text output of the tools is left as it is.
+
+#include <sys/utsname.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_timer.h"
+#ifdef __APPLE__
+#include <sys/mount.h>
+#include <sys/sysctl.h>
+#endif
+
+struct HostInfo {
+    std::string hostname;
+    std::string cpu;
+    std::string kernel;
+    std::string filesystem;     // type of the filesystem under test
+    std::string mount_source;   // device of the filesystem under test
+    std::string mount_options;
+    std::string timestamp;      // UTC, ISO 8601
+};
+
+struct BenchResult {
+    std::string name;                          // what was measured, e.g. "write"
+    std::map<std::string, std::string> params; // e.g. size_mb=100
+    std::string metric;                        // e.g. "throughput"
+    std::string unit;                          // e.g. "MB/s"
+    bool higher_is_better = true;
+    double value = 0;                          // the reported value
+    std::vector<double> samples;               // repetitions behind the value, if any
+
+    template <typename T>
+    BenchResult& param(const std::string& key, const T& v) {
+        std::ostringstream out;
+        out << v;
+        params[key] = out.str();
+        return *this;
+    }
+
+    BenchResult& lower_is_better() {
+        higher_is_better = false;
+        return *this;
+    }
+
+    BenchResult& with_samples(const std::vector<double>& s) {
+        samples = s;
+        return *this;
+    }
+
+    // Identifies the same measurement in another run
+    std::string key() const {
+        std::string k = name;
+        for (const auto& p : params) {
+            k += " " + p.first + "=" + p.second;
+        }
+        return k + " " + metric;
+    }
+};
+
+namespace bench_detail {
+
+inline std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\n\r");
+    size_t e = s.find_last_not_of(" \t\n\r");
+    return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+}
+
+inline std::string cpu_model() {
+#ifdef __APPLE__
+    char buf[256];
+    size_t len = sizeof(buf);
+    if (sysctlbyname("machdep.cpu.brand_string", buf, &len, nullptr, 0) == 0) {
+        return std::string(buf, strnlen(buf, len));
+    }
+    return "";
+#else
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    std::string fallback;
+    while (std::getline(in, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string key = trim(line.substr(0, colon));
+        if (key == "model name") return trim(line.substr(colon + 1));
+        if (fallback.empty() && (key == "Hardware" || key == "CPU part" || key == "cpu model")) {
+            fallback = trim(line.substr(colon + 1));
+        }
+    }
+    return fallback;
+#endif
+}
+
+// Filesystem type, source and mount options of the filesystem holding `path`
+inline void filesystem_of(const std::string& path, HostInfo& host) {
+    if (path.empty()) return;
+    // The test file may not exist yet (or any more): use the nearest existing parent
+    std::string existing = path;
+    char resolved[PATH_MAX];
+    while (!realpath(existing.c_str(), resolved)) {
+        size_t slash = existing.find_last_of('/');
+        if (slash == std::string::npos) {
+            existing = ".";
+        } else if (slash == 0) {
+            existing = "/";
+        } else {
+            existing.erase(slash);
+        }
+        if (existing == "." || existing == "/") {
+            if (!realpath(existing.c_str(), resolved)) return;
+            break;
+        }
+    }
+#ifdef __APPLE__
+    struct statfs fs;
+    if (statfs(resolved, &fs) == 0) {
+        host.filesystem = fs.f_fstypename;
+        host.mount_source = fs.f_mntfromname;
+        std::ostringstream flags;
+        flags << "flags=0x" << std::hex << fs.f_flags;
+        host.mount_options = flags.str();
+    }
+#else
+    // A memfd (e.g. /proc/self/fd/N) lives on the kernel's internal tmpfs mount
+    char link[PATH_MAX];
+    ssize_t n = readlink(path.c_str(), link, sizeof(link) - 1);
+    if (n > 0 && std::string(link, n).rfind("/memfd:", 0) == 0) {
+        host.filesystem = "memfd";
+        return;
+    }
+    // mountinfo: id parent major:minor root mount_point options [optional...] - type source super_options
+    std::ifstream in("/proc/self/mountinfo");
+    std::string line;
+    size_t best = 0;
+    std::string target(resolved);
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string id, parent, dev, root, mount_point, options, field;
+        fields >> id >> parent >> dev >> root >> mount_point >> options;
+        while (fields >> field && field != "-") {
+        }
+        std::string type, source, super_options;
+        fields >> type >> source >> super_options;
+        bool prefix = target.compare(0, mount_point.size(), mount_point) == 0 &&
+                      (mount_point == "/" || target.size() == mount_point.size() ||
+                       target[mount_point.size()] == '/');
+        if (prefix && mount_point.size() >= best) {
+            best = mount_point.size();
+            host.filesystem = type;
+            host.mount_source = source;
+            host.mount_options = options + (super_options.empty() ? "" : "," + super_options);
+        }
+    }
+#endif
+}
+
+inline std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+inline std::string json_number(double v) {
+    if (!std::isfinite(v)) return "null";
+    std::ostringstream out;
+    out << std::setprecision(12) << v;
+    return out.str();
+}
+
+inline std::string csv_escape(const std::string& s) {
+    if (s.find_first_of(",\"\n") == std::string::npos) return s;
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// Just enough JSON to read back what write_json() produces
+struct JsonValue {
+    enum Type { Null, Bool, Number, String, Array, Object } type = Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    const JsonValue* get(const std::string& key) const {
+        auto it = object.find(key);
+        return it == object.end() ? nullptr : &it->second;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : s_(text) {}
+
+    bool parse(JsonValue& out) {
+        bool ok = value(out);
+        skip_ws();
+        return ok && pos_ == s_.size();
+    }
+
+private:
+    void skip_ws() {
+        while (pos_ < s_.size() && isspace(static_cast<unsigned char>(s_[pos_]))) ++pos_;
+    }
+
+    bool literal(const char* word) {
+        size_t len = strlen(word);
+        if (s_.compare(pos_, len, word) != 0) return false;
+        pos_ += len;
+        return true;
+    }
+
+    // Four hex digits of a \u escape
+    bool hex4(unsigned& value) {
+        if (pos_ + 4 > s_.size()) return false;
+        value = 0;
+        for (size_t end = pos_ + 4; pos_ < end; ++pos_) {
+            unsigned char c = static_cast<unsigned char>(s_[pos_]);
+            if (!isxdigit(c)) return false;
+            value = value * 16 + (isdigit(c) ? c - '0' : (c | 0x20) - 'a' + 10);
+        }
+        return true;
+    }
+
+    // Names are compared as the UTF-8 that write_json() writes unescaped
+    static void append_utf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool string(std::string& out) {
+        if (s_[pos_] != '"') return false;
+        ++pos_;
+        while (pos_ < s_.size() && s_[pos_] != '"') {
+            char c = s_[pos_++];
+            if (c == '\\' && pos_ < s_.size()) {
+                char e = s_[pos_++];
+                switch (e) {
+                    case 'n': out += '\n'; break;
+                    case 't': out += '\t'; break;
+                    case 'r': out += '\r'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'u': {
+                        unsigned cp;
+                        if (!hex4(cp)) return false;
+                        // A character outside the BMP comes as a surrogate pair
+                        if (cp >= 0xD800 && cp <= 0xDBFF) {
+                            unsigned low;
+                            if (s_.compare(pos_, 2, "\\u") != 0) return false;
+                            pos_ += 2;
+                            if (!hex4(low) || low < 0xDC00 || low > 0xDFFF) return false;
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                            return false;
+                        }
+                        append_utf8(out, cp);
+                        break;
+                    }
+                    default: out += e;
+                }
+            } else {
+                out += c;
+            }
+        }
+        if (pos_ >= s_.size()) return false;
+        ++pos_;
+        return true;
+    }
+
+    bool value(JsonValue& out) {
+        skip_ws();
+        if (pos_ >= s_.size()) return false;
+        char c = s_[pos_];
+        if (c == '{') {
+            out.type = JsonValue::Object;
+            ++pos_;
+            skip_ws();
+            if (pos_ < s_.size() && s_[pos_] == '}') { ++pos_; return true; }
+            while (true) {
+                skip_ws();
+                std::string key;
+                if (pos_ >= s_.size() || !string(key)) return false;
+                skip_ws();
+                if (pos_ >= s_.size() || s_[pos_++] != ':') return false;
+                if (!value(out.object[key])) return false;
+                skip_ws();
+                if (pos_ >= s_.size()) return false;
+                if (s_[pos_] == ',') { ++pos_; continue; }
+                if (s_[pos_] == '}') { ++pos_; return true; }
+                return false;
+            }
+        }
+        if (c == '[') {
+            out.type = JsonValue::Array;
+            ++pos_;
+            skip_ws();
+            if (pos_ < s_.size() && s_[pos_] == ']') { ++pos_; return true; }
+            while (true) {
+                out.array.emplace_back();
+                if (!value(out.array.back())) return false;
+                skip_ws();
+                if (pos_ >= s_.size()) return false;
+                if (s_[pos_] == ',') { ++pos_; continue; }
+                if (s_[pos_] == ']') { ++pos_; return true; }
+                return false;
+            }
+        }
+        if (c == '"') {
+            out.type = JsonValue::String;
+            return string(out.string);
+        }
+        if (literal("true")) { out.type = JsonValue::Bool; out.boolean = true; return true; }
+        if (literal("false")) { out.type = JsonValue::Bool; return true; }
+        if (literal("null")) { out.type = JsonValue::Null; return true; }
+        const char* begin = s_.c_str() + pos_;
+        char* end = nullptr;
+        out.number = strtod(begin, &end);
+        if (end == begin) return false;
+        out.type = JsonValue::Number;
+        pos_ += end - begin;
+        return true;
+    }
+
+    const std::string& s_;
+    size_t pos_ = 0;
+};
+
+// Welch's t-test: is the difference of the means significant at 95%?
+inline bool significant_difference(const std::vector<double>& a, const std::vector<double>& b) {
+    double va = variance(a) / a.size();
+    double vb = variance(b) / b.size();
+    double se = std::sqrt(va + vb);
+    double diff = std::fabs(mean(a) - mean(b));
+    if (se == 0) return diff > 0;
+    double df = (va + vb) * (va + vb) /
+                (va * va / (a.size() - 1) + vb * vb / (b.size() - 1));
+    return diff / se > t_critical_95(df);
+}
+
+} // namespace bench_detail
+
+inline HostInfo collect_host_info(const std::string& path) {
+    HostInfo host;
+    struct utsname u;
+    if (uname(&u) == 0) {
+        host.hostname = u.nodename;
+        host.kernel = std::string(u.sysname) + " " + u.release + " " + u.version + " " + u.machine;
+    }
+    host.cpu = bench_detail::cpu_model();
+    bench_detail::filesystem_of(path, host);
+    char buf[32];
+    time_t now = time(nullptr);
+    struct tm tm_utc;
+    gmtime_r(&now, &tm_utc);
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm_utc);
+    host.timestamp = buf;
+    return host;
+}
+
+class BenchResults {
+public:
+    explicit BenchResults(const std::string& tool)
+        : tool_(tool), host_(collect_host_info("")) {}
+
+    // Directory or file on the filesystem under test, for the host metadata.
+    // Probed right away, while a temporary filesystem under test still exists.
+    void set_path(const std::string& path) { host_ = collect_host_info(path); }
+
+    BenchResult& add(const std::string& name, const std::string& metric, double value,
+                     const std::string& unit) {
+        results_.emplace_back();
+        BenchResult& r = results_.back();
+        r.name = name;
+        r.metric = metric;
+        r.value = value;
+        r.unit = unit;
+        // Times are better when smaller, rates when larger
+        r.higher_is_better = !(unit == "ns" || unit == "us" || unit == "ms" || unit == "s");
+        return r;
+    }
+
+    // The median of the runs, with the runs left after outlier rejection as samples
+    BenchResult& add(const std::string& name, const std::string& metric, const Summary& summary,
+                     const std::string& unit) {
+        return add(name, metric, summary.median, unit).with_samples(summary.kept);
+    }
+
+    const std::vector<BenchResult>& results() const { return results_; }
+    const std::string& tool() const { return tool_; }
+
+    bool write_json(const std::string& file) const {
+        using namespace bench_detail;
+        const HostInfo& host = host_;
+        std::ofstream out(file);
+        if (!out) {
+            std::cerr << "Cannot write " << file << std::endl;
+            return false;
+        }
+        out << "{\n  \"tool\": \"" << json_escape(tool_) << "\",\n  \"host\": {\n"
+            << "    \"hostname\": \"" << json_escape(host.hostname) << "\",\n"
+            << "    \"cpu\": \"" << json_escape(host.cpu) << "\",\n"
+            << "    \"kernel\": \"" << json_escape(host.kernel) << "\",\n"
+            << "    \"filesystem\": \"" << json_escape(host.filesystem) << "\",\n"
+            << "    \"mount_source\": \"" << json_escape(host.mount_source) << "\",\n"
+            << "    \"mount_options\": \"" << json_escape(host.mount_options) << "\",\n"
+            << "    \"timestamp\": \"" << json_escape(host.timestamp) << "\"\n  },\n"
+            << "  \"results\": [";
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const BenchResult& r = results_[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": \"" << json_escape(r.name) << "\", \"params\": {";
+            size_t n = 0;
+            for (const auto& p : r.params) {
+                out << (n++ ? ", " : "") << "\"" << json_escape(p.first) << "\": \""
+                    << json_escape(p.second) << "\"";
+            }
+            out << "}, \"metric\": \"" << json_escape(r.metric) << "\", \"unit\": \""
+                << json_escape(r.unit) << "\", \"better\": \""
+                << (r.higher_is_better ? "higher" : "lower") << "\", \"value\": "
+                << json_number(r.value) << ", \"samples\": [";
+            for (size_t s = 0; s < r.samples.size(); ++s) {
+                out << (s ? ", " : "") << json_number(r.samples[s]);
+            }
+            out << "]}";
+        }
+        out << "\n  ]\n}\n";
+        return static_cast<bool>(out);
+    }
+
+    bool write_csv(const std::string& file) const {
+        using namespace bench_detail;
+        const HostInfo& host = host_;
+        std::ofstream out(file);
+        if (!out) {
+            std::cerr << "Cannot write " << file << std::endl;
+            return false;
+        }
+        out << "tool,name,params,metric,unit,better,value,samples,stddev,"
+               "hostname,cpu,kernel,filesystem,mount_options,timestamp\n";
+        for (const BenchResult& r : results_) {
+            std::string params;
+            for (const auto& p : r.params) {
+                params += (params.empty() ? "" : ";") + p.first + "=" + p.second;
+            }
+            out << csv_escape(tool_) << "," << csv_escape(r.name) << "," << csv_escape(params) << ","
+                << csv_escape(r.metric) << "," << csv_escape(r.unit) << ","
+                << (r.higher_is_better ? "higher" : "lower") << "," << json_number(r.value) << ","
+                << r.samples.size() << "," << json_number(std::sqrt(variance(r.samples))) << ","
+                << csv_escape(host.hostname) << "," << csv_escape(host.cpu) << ","
+                << csv_escape(host.kernel) << "," << csv_escape(host.filesystem) << ","
+                << csv_escape(host.mount_options) << "," << csv_escape(host.timestamp) << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+    // Compare with a baseline written by write_json(). A result regresses when
+    // it is worse by more than `threshold_pct` percent and, if both runs have
+    // repeated samples, the difference is significant (Welch's t-test, 95%).
+    // Baseline results missing from this run count as regressions.
+    // Returns the number of regressions, or -1 if the baseline cannot be read.
+    int compare(const std::string& baseline_file, double threshold_pct) const {
+        using namespace bench_detail;
+        std::ifstream in(baseline_file);
+        std::stringstream text;
+        text << in.rdbuf();
+        JsonValue root;
+        if (!in || !JsonParser(text.str()).parse(root) || root.type != JsonValue::Object) {
+            std::cerr << "Cannot read baseline " << baseline_file << std::endl;
+            return -1;
+        }
+
+        std::map<std::string, BenchResult> baseline;
+        const JsonValue* list = root.get("results");
+        if (list) {
+            for (const JsonValue& item : list->array) {
+                BenchResult r;
+                if (const JsonValue* v = item.get("name")) r.name = v->string;
+                if (const JsonValue* v = item.get("metric")) r.metric = v->string;
+                if (const JsonValue* v = item.get("value")) r.value = v->number;
+                if (const JsonValue* v = item.get("params")) {
+                    for (const auto& p : v->object) r.params[p.first] = p.second.string;
+                }
+                if (const JsonValue* v = item.get("samples")) {
+                    for (const JsonValue& s : v->array) r.samples.push_back(s.number);
+                }
+                baseline[r.key()] = r;
+            }
+        }
+
+        std::cout << "\n=== Comparison with " << baseline_file << " (threshold "
+                  << threshold_pct << "%) ===" << std::endl;
+        int regressions = 0;
+        std::set<std::string> current;
+        for (const BenchResult& r : results_) {
+            current.insert(r.key());
+            auto it = baseline.find(r.key());
+            std::cout << r.key() << ": ";
+            if (it == baseline.end()) {
+                std::cout << "not in baseline" << std::endl;
+                continue;
+            }
+            const BenchResult& b = it->second;
+            double change = b.value != 0 ? (r.value - b.value) / std::fabs(b.value) * 100 : 0;
+            double worse = r.higher_is_better ? -change : change;
+            bool significant = r.samples.size() < 2 || b.samples.size() < 2 ||
+                               significant_difference(r.samples, b.samples);
+            const char* verdict = "ok";
+            if (worse > threshold_pct && significant) {
+                verdict = "REGRESSION";
+                ++regressions;
+            } else if (-worse > threshold_pct && significant) {
+                verdict = "improved";
+            } else if (std::fabs(worse) > threshold_pct) {
+                verdict = "ok (not significant)";
+            }
+            std::cout << b.value << " -> " << r.value << " " << r.unit << " ("
+                      << std::showpos << std::fixed << std::setprecision(1) << change << "%"
+                      << std::noshowpos << std::defaultfloat << std::setprecision(6) << ") "
+                      << verdict << std::endl;
+        }
+        for (const auto& b : baseline) {
+            if (current.count(b.first) == 0) {
+                std::cout << b.first << ": missing from this run REGRESSION" << std::endl;
+                ++regressions;
+            }
+        }
+        std::cout << "Regressions: " << regressions << std::endl;
+        return regressions;
+    }
+
+private:
+    std::string tool_;
+    HostInfo host_;
+    std::vector<BenchResult> results_;
+};
+
+struct ResultsOptions {
+    std::string json;
+    std::string csv;
+    std::string compare;
+    double threshold_pct = 5.0;
+};
+
+inline void print_results_help() {
+    std::cout << "  --json=FILE     Write the results with host metadata as JSON\n"
+              << "  --csv=FILE      Write the results as CSV\n"
+              << "  --compare=FILE  Compare with a baseline JSON; exit code 2 on regressions\n"
+              << "  --threshold=N   Smallest change in percent reported as a regression (default: 5)\n";
+}
+
+// Handles the --json/--csv/--compare/--threshold arguments; returns false for any other argument
+inline bool parse_results_arg(const std::string& arg, ResultsOptions& opts) {
+    if (arg.rfind("--json=", 0) == 0) {
+        opts.json = arg.substr(7);
+    } else if (arg.rfind("--csv=", 0) == 0) {
+        opts.csv = arg.substr(6);
+    } else if (arg.rfind("--compare=", 0) == 0) {
+        opts.compare = arg.substr(10);
+    } else if (arg.rfind("--threshold=", 0) == 0) {
+        opts.threshold_pct = std::stod(arg.substr(12));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+constexpr int EXIT_REGRESSION = 2;
+
+// Write and compare the results as requested. Returns the exit code for main():
+// 0, 1 if a file could not be written or read, EXIT_REGRESSION on regressions.
+inline int finish_results(const BenchResults& results, const ResultsOptions& opts) {
+    int code = 0;
+    if (!opts.json.empty() && !results.write_json(opts.json)) code = 1;
+    if (!opts.csv.empty() && !results.write_csv(opts.csv)) code = 1;
+    if (!opts.compare.empty()) {
+        int regressions = results.compare(opts.compare, opts.threshold_pct);
+        if (regressions < 0) {
+            code = 1;
+        } else if (regressions > 0) {
+            code = EXIT_REGRESSION;
+        }
+    }
+    return code;
+}
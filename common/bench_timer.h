@@ -0,0 +1,251 @@
+#pragma once
+
+// Timing and repetition engine shared by all tools.
+//
+// bench_now() is a monotonic clock that is not slewed by NTP
+// (CLOCK_MONOTONIC_RAW where available) or, with --timer=tsc, the calibrated
+// time stamp counter. measure() runs a benchmark --warmup times without
+// recording it and then --reps times, and summarize() turns the samples into
+// median, mean, stddev and a 95% confidence interval after rejecting outliers
+// (Tukey fences: outside 1.5 IQR of the quartiles).
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace bench_detail {
+
+inline double clock_now() {
+    timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct TscClock {
+    bool enabled = false;
+    double seconds_per_tick = 0;
+    uint64_t base_ticks = 0;
+    double base_seconds = 0;
+};
+
+inline TscClock& tsc_clock() {
+    static TscClock clock;
+    return clock;
+}
+
+inline double mean(const std::vector<double>& v) {
+    double sum = 0;
+    for (double x : v) sum += x;
+    return v.empty() ? 0 : sum / v.size();
+}
+
+inline double variance(const std::vector<double>& v) {
+    if (v.size() < 2) return 0;
+    double m = mean(v);
+    double sum = 0;
+    for (double x : v) sum += (x - m) * (x - m);
+    return sum / (v.size() - 1);
+}
+
+// Two-sided 95% critical value of Student's t distribution
+inline double t_critical_95(double df) {
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df < 1) df = 1;
+    if (df <= 30) return table[static_cast<int>(df) - 1];
+    return 1.96 + 2.4 / df;
+}
+
+// Linear interpolation between the closest ranks of a sorted vector
+inline double quantile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    double pos = q * (sorted.size() - 1);
+    size_t lo = static_cast<size_t>(pos);
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - lo);
+}
+
+} // namespace bench_detail
+
+// Seconds on a monotonic clock; only differences are meaningful
+inline double bench_now() {
+#ifdef BENCH_HAVE_TSC
+    const bench_detail::TscClock& tsc = bench_detail::tsc_clock();
+    if (tsc.enabled) {
+        return tsc.base_seconds + (__rdtsc() - tsc.base_ticks) * tsc.seconds_per_tick;
+    }
+#endif
+    return bench_detail::clock_now();
+}
+
+// Switch bench_now() to the TSC, calibrated against the monotonic clock.
+// Returns false (and keeps the clock) without an invariant TSC.
+inline bool use_tsc_timer() {
+#ifdef BENCH_HAVE_TSC
+    unsigned eax, ebx, ecx, edx;
+    // CPUID 0x80000007 EDX bit 8: the TSC runs at a constant rate in all power states
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8))) {
+        return false;
+    }
+    bench_detail::TscClock& tsc = bench_detail::tsc_clock();
+    double start = bench_detail::clock_now();
+    uint64_t start_ticks = __rdtsc();
+    double end = start;
+    while (end - start < 0.05) {
+        end = bench_detail::clock_now();
+    }
+    uint64_t end_ticks = __rdtsc();
+    tsc.seconds_per_tick = (end - start) / (end_ticks - start_ticks);
+    tsc.base_ticks = end_ticks;
+    tsc.base_seconds = end;
+    tsc.enabled = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+struct MeasureOptions {
+    int warmup = 0;            // runs before the measured ones, not recorded
+    int reps = 1;              // measured runs
+    bool reject_outliers = true;
+    std::string timer = "monotonic";
+};
+
+struct Summary {
+    std::vector<double> samples;  // all measured values
+    std::vector<double> kept;     // the samples left after outlier rejection
+    double median = 0;
+    double mean = 0;
+    double stddev = 0;
+    double ci_low = 0;            // 95% confidence interval of the mean
+    double ci_high = 0;
+    double min = 0;
+    double max = 0;
+};
+
+inline Summary summarize(const std::vector<double>& samples, bool reject_outliers = true) {
+    using namespace bench_detail;
+    Summary s;
+    s.samples = samples;
+    if (samples.empty()) return s;
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    // Quartiles of fewer than four samples say nothing about outliers
+    if (reject_outliers && sorted.size() >= 4) {
+        double q1 = quantile(sorted, 0.25);
+        double q3 = quantile(sorted, 0.75);
+        double fence = 1.5 * (q3 - q1);
+        for (double x : sorted) {
+            if (x >= q1 - fence && x <= q3 + fence) s.kept.push_back(x);
+        }
+    } else {
+        s.kept = sorted;
+    }
+    s.median = quantile(s.kept, 0.5);
+    s.mean = mean(s.kept);
+    s.stddev = std::sqrt(variance(s.kept));
+    s.min = s.kept.front();
+    s.max = s.kept.back();
+    double half = s.kept.size() > 1
+        ? t_critical_95(s.kept.size() - 1) * s.stddev / std::sqrt(static_cast<double>(s.kept.size()))
+        : 0;
+    s.ci_low = s.mean - half;
+    s.ci_high = s.mean + half;
+    return s;
+}
+
+// All tools take percentiles by the nearest-rank rule: the p-th percentile
+// of n values is the ceil(p / 100 * n)-th smallest, i.e. the smallest value
+// with at least p% of the values at or below it. Returns that rank, 1..n.
+inline size_t percentile_rank(size_t n, double p) {
+    // The epsilon keeps e.g. 99% of 100 values at rank 99 despite rounding
+    double rank = std::ceil(p / 100 * n - 1e-9);
+    return static_cast<size_t>(std::min(static_cast<double>(n), std::max(1.0, rank)));
+}
+
+// The p-th percentile (0..100) of `sorted`, by percentile_rank()
+template <typename T>
+T percentile(const std::vector<T>& sorted, double p) {
+    return sorted.empty() ? T() : sorted[percentile_rank(sorted.size(), p) - 1];
+}
+
+// The median, followed by the spread when there was more than one run
+inline std::ostream& operator<<(std::ostream& out, const Summary& s) {
+    out << s.median;
+    if (s.samples.size() > 1) {
+        out << " (sd " << s.stddev << ", 95% CI " << s.ci_low << ".." << s.ci_high
+            << ", n=" << s.kept.size();
+        if (s.kept.size() != s.samples.size()) {
+            out << "/" << s.samples.size();
+        }
+        out << ")";
+    }
+    return out;
+}
+
+// Run `fn` opts.warmup times unrecorded, then opts.reps times. `fn(measured)`
+// returns false on failure, which stops the repetitions.
+template <typename Fn>
+bool measure(const MeasureOptions& opts, Fn fn) {
+    for (int i = 0; i < opts.warmup; ++i) {
+        if (!fn(false)) return false;
+    }
+    for (int i = 0; i < opts.reps; ++i) {
+        if (!fn(true)) return false;
+    }
+    return true;
+}
+
+inline void print_measure_help(const MeasureOptions& defaults = MeasureOptions()) {
+    std::cout << "  --warmup=N      Unrecorded runs before the measured ones (default: "
+              << defaults.warmup << ")\n"
+              << "  --reps=N        Measured runs, reported as median with stddev and 95% CI\n"
+              << "                  (default: " << defaults.reps << ")\n"
+              << "  --keep-outliers Do not reject runs outside 1.5 IQR of the quartiles\n"
+              << "  --timer=monotonic|tsc  Clock: CLOCK_MONOTONIC_RAW (default) or the TSC\n";
+}
+
+// Handles the --warmup/--reps/--keep-outliers/--timer arguments; returns false
+// for any other argument
+inline bool parse_measure_arg(const std::string& arg, MeasureOptions& opts) {
+    if (arg.rfind("--warmup=", 0) == 0) {
+        opts.warmup = std::max(0, std::stoi(arg.substr(9)));
+    } else if (arg.rfind("--reps=", 0) == 0) {
+        opts.reps = std::max(1, std::stoi(arg.substr(7)));
+    } else if (arg == "--keep-outliers") {
+        opts.reject_outliers = false;
+    } else if (arg.rfind("--timer=", 0) == 0) {
+        opts.timer = arg.substr(8);
+        if (opts.timer != "monotonic" && opts.timer != "tsc") {
+            std::cerr << "Invalid value for --timer: " << arg << ", using monotonic" << std::endl;
+            opts.timer = "monotonic";
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Apply --timer; call once at startup, before anything is timed
+inline void init_timer(const MeasureOptions& opts) {
+    if (opts.timer == "tsc" && !use_tsc_timer()) {
+        std::cerr << "No invariant TSC, using the monotonic clock" << std::endl;
+    }
+}
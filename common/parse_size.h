@@ -0,0 +1,23 @@
+#pragma once
+
+// Size arguments shared by the tools' command lines.
+
+#include <cstddef>
+#include <regex>
+#include <stdexcept>
+#include <string>
+
+// Parse size string with suffix (e.g., "2G", "512M", "128K")
+inline size_t parse_size(const std::string& str) {
+    std::regex re(R"(^(\d+)([KMG]?)$)", std::regex::icase);
+    std::smatch match;
+    if (!std::regex_match(str, match, re)) {
+        throw std::invalid_argument("Invalid size format: " + str);
+    }
+    size_t base = std::stoull(match[1]);
+    std::string suffix = match[2].str();
+    if (suffix == "K" || suffix == "k") return base * (1ULL << 10);
+    if (suffix == "M" || suffix == "m") return base * (1ULL << 20);
+    if (suffix == "G" || suffix == "g") return base * (1ULL << 30);
+    return base;
+}
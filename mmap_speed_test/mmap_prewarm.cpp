@@ -0,0 +1,420 @@
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "bench_results.h"
+#include "parse_size.h"
+
+// Page cache prewarmer: reports how much of every file is resident (mincore)
+// and loads the files into the page cache with several threads, highest
+// priority (first on the command line) first, within a memory budget.
+
+struct Options {
+    std::string method = "fadvise";  // report, fadvise, readahead, madvise, touch
+    int threads = 4;
+    size_t budget = 0;               // bytes of page cache to fill, 0 = no limit
+    size_t chunk = 4 << 20;          // unit of work of one thread
+    bool evict = false;              // drop the files from the cache first
+    std::vector<std::string> files;  // in priority order
+    MeasureOptions measure;
+    ResultsOptions results;
+    bool help = false;
+};
+
+void print_help(const char* program_name) {
+    std::cout << "Usage: " << program_name
+              << " [-m=report|fadvise|readahead|madvise|touch] [-j=N] [-l=N[KMG]]\n"
+              << "       [-c=N[KMG]] [-e] [--warmup=N] [--reps=N] [--keep-outliers]\n"
+              << "       [--timer=monotonic|tsc] [--json=FILE] [--csv=FILE] [--compare=FILE]\n"
+              << "       [--threshold=N] [-h] file...\n"
+              << "  file...  Files to warm, highest priority first\n"
+              << "  -m=report     Only print the page cache residency of the files\n"
+              << "  -m=fadvise    posix_fadvise(POSIX_FADV_WILLNEED) (default)\n"
+              << "  -m=readahead  readahead() (Linux)\n"
+              << "  -m=madvise    madvise(MADV_WILLNEED) on a shared mapping\n"
+              << "  -m=touch      Read one byte of every page of a shared mapping\n"
+              << "  -j=N     Number of warming threads (default: 4)\n"
+              << "  -l=N[KMG] Memory budget: files are warmed in priority order until\n"
+              << "           this much is covered, the last one partially (default: no limit)\n"
+              << "  -c=N[KMG] Size of the range one thread warms at a time (default: 4M)\n"
+              << "  -e       Drop the files from the page cache first (cold start)\n"
+              << "  -h       Show this help message\n";
+    print_measure_help();
+    print_results_help();
+}
+
+Options parse_args(int argc, char* argv[]) {
+    Options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        try {
+            if (arg == "-h") {
+                opts.help = true;
+            } else if (arg.rfind("-m=", 0) == 0) {
+                opts.method = arg.substr(3);
+                if (opts.method != "report" && opts.method != "fadvise" &&
+                    opts.method != "readahead" && opts.method != "madvise" &&
+                    opts.method != "touch") {
+                    std::cerr << "Invalid value for -m: " << arg << "\n";
+                    opts.help = true;
+                }
+            } else if (arg.rfind("-j=", 0) == 0) {
+                opts.threads = std::max(1, std::stoi(arg.substr(3)));
+            } else if (arg.rfind("-l=", 0) == 0) {
+                opts.budget = parse_size(arg.substr(3));
+            } else if (arg.rfind("-c=", 0) == 0) {
+                opts.chunk = std::max<size_t>(4096, parse_size(arg.substr(3)));
+            } else if (arg == "-e") {
+                opts.evict = true;
+            } else if (parse_measure_arg(arg, opts.measure)) {
+            } else if (parse_results_arg(arg, opts.results)) {
+            } else if (arg.rfind("-", 0) == 0) {
+                std::cerr << "Unknown argument: " << arg << "\n";
+                opts.help = true;
+            } else {
+                opts.files.push_back(arg);
+            }
+        }
+        catch (...) {
+            std::cerr << "Invalid value: " << arg << "\n";
+            opts.help = true;
+        }
+    }
+    if (opts.files.empty()) {
+        opts.help = true;
+    }
+
+    return opts;
+}
+
+// A data file mapped read-only; `warm` is the prefix that fits in the budget
+struct MappedFile {
+    std::string path;
+    int fd = -1;
+    size_t size = 0;
+    size_t warm = 0;
+    void* map = nullptr;
+};
+
+bool open_file(const std::string& path, MappedFile& file) {
+    file.path = path;
+    file.fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (file.fd < 0 || fstat(file.fd, &st) != 0) {
+        perror(path.c_str());
+        return false;
+    }
+    file.size = static_cast<size_t>(st.st_size);
+    if (file.size == 0) {
+        return true;
+    }
+    file.map = mmap(nullptr, file.size, PROT_READ, MAP_SHARED, file.fd, 0);
+    if (file.map == MAP_FAILED) {
+        perror("mmap");
+        file.map = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void close_file(MappedFile& file) {
+    if (file.map != nullptr) {
+        munmap(file.map, file.size);
+    }
+    if (file.fd >= 0) {
+        close(file.fd);
+    }
+}
+
+size_t page_size() {
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Bytes of [0, length) of the file that are in the page cache
+size_t resident_bytes(const MappedFile& file, size_t length) {
+    if (file.map == nullptr || length == 0) {
+        return 0;
+    }
+    size_t page = page_size();
+    size_t pages = (length + page - 1) / page;
+#ifdef __APPLE__
+    std::vector<char> vec(pages);
+#else
+    std::vector<unsigned char> vec(pages);
+#endif
+    if (mincore(file.map, length, vec.data()) != 0) {
+        perror("mincore");
+        return 0;
+    }
+    size_t resident = 0;
+    for (size_t i = 0; i < pages; ++i) {
+        if (vec[i] & 1) {
+            resident += std::min(page, length - i * page);
+        }
+    }
+    return resident;
+}
+
+// Drop the clean cached pages of the file
+void evict(const MappedFile& file) {
+    // Pages still mapped by an earlier touch would stay in the cache
+    if (file.map != nullptr) {
+        madvise(file.map, file.size, MADV_DONTNEED);
+    }
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(file.fd, 0, 0, POSIX_FADV_DONTNEED);
+#else
+    if (file.map != nullptr) {
+        msync(file.map, file.size, MS_INVALIDATE);
+    }
+#endif
+}
+
+// Ask for or load one range of a file; returns 0 or the error of the method
+int warm_range(const std::string& method, const MappedFile& file, size_t offset, size_t length,
+                uint64_t& sink) {
+    if (method == "fadvise") {
+#ifdef POSIX_FADV_WILLNEED
+        // Returns the error number instead of setting errno
+        return posix_fadvise(file.fd, offset, length, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+        radvisory advice;
+        advice.ra_offset = static_cast<off_t>(offset);
+        advice.ra_count = static_cast<int>(length);
+        return fcntl(file.fd, F_RDADVISE, &advice) != -1 ? 0 : errno;
+#else
+        return ENOSYS;
+#endif
+    } else if (method == "readahead") {
+#ifdef __linux__
+        return readahead(file.fd, offset, length) == 0 ? 0 : errno;
+#else
+        return ENOSYS;
+#endif
+    } else if (method == "madvise") {
+        char* start = static_cast<char*>(file.map) + offset;
+        return madvise(start, length, MADV_WILLNEED) == 0 ? 0 : errno;
+    }
+    // touch
+    const volatile char* p = static_cast<const char*>(file.map);
+    size_t page = page_size();
+    uint64_t sum = 0;
+    for (size_t i = offset; i < offset + length; i += page) {
+        sum += p[i];
+    }
+    sink += sum;
+    return 0;
+}
+
+struct Chunk {
+    size_t file;
+    size_t offset;
+    size_t length;
+};
+
+struct WarmRun {
+    bool ok = true;
+    int err = 0;
+    double issue_seconds = 0;     // until every thread finished its calls
+    double resident_seconds = 0;  // until the pages were in the cache (or stopped arriving)
+    size_t loaded = 0;            // bytes that became resident
+};
+
+uint64_t checksum_sink = 0;
+
+// Warm all chunks with `threads` threads taking them in priority order, then
+// wait for the asynchronous methods until the pages arrive
+WarmRun warm_once(const Options& opts, std::vector<MappedFile>& files,
+                  const std::vector<Chunk>& chunks, size_t target) {
+    WarmRun run;
+    if (opts.evict) {
+        for (const MappedFile& file : files) {
+            evict(file);
+        }
+    }
+    size_t before = 0;
+    for (const MappedFile& file : files) {
+        before += resident_bytes(file, file.warm);
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<int> failed{0};
+    std::vector<uint64_t> sums(opts.threads, 0);
+    std::vector<std::thread> workers;
+    double start = bench_now();
+    for (int t = 0; t < opts.threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for (size_t i = next++; i < chunks.size(); i = next++) {
+                const Chunk& c = chunks[i];
+                int err = warm_range(opts.method, files[c.file], c.offset, c.length, sums[t]);
+                if (err != 0) {
+                    failed = err;
+                }
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    run.issue_seconds = bench_now() - start;
+    for (uint64_t s : sums) {
+        checksum_sink += s;
+    }
+    if (failed) {
+        run.ok = false;
+        run.err = failed;
+        return run;
+    }
+
+    // fadvise, readahead and madvise only start the reads
+    size_t resident = 0;
+    size_t last = 0;
+    double last_change = bench_now();
+    while (true) {
+        resident = 0;
+        for (const MappedFile& file : files) {
+            resident += resident_bytes(file, file.warm);
+        }
+        double now = bench_now();
+        if (resident != last) {
+            last = resident;
+            last_change = now;
+        }
+        if (resident >= target || now - last_change > 0.5) {
+            run.resident_seconds = (resident >= target ? now : last_change) - start;
+            break;
+        }
+        usleep(5000);
+    }
+    run.loaded = resident > before ? resident - before : 0;
+    return run;
+}
+
+void print_residency(const char* title, const std::vector<MappedFile>& files) {
+    std::cout << title << "\n";
+    for (const MappedFile& file : files) {
+        size_t resident = resident_bytes(file, file.size);
+        double percent = file.size ? 100.0 * resident / file.size : 100.0;
+        std::cout << "  " << file.path << " | Size: " << (file.size >> 20) << " MB"
+                  << " | Resident: " << (resident >> 20) << " MB (" << percent << "%)";
+        if (file.warm != file.size) {
+            std::cout << " | Budget: " << (file.warm >> 20) << " MB";
+        }
+        std::cout << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parse_args(argc, argv);
+
+    if (options.help) {
+        print_help(argv[0]);
+        return 0;
+    }
+#ifndef __linux__
+    if (options.method == "readahead") {
+        std::cerr << "readahead() is only available on Linux\n";
+        return 1;
+    }
+#endif
+
+    std::vector<MappedFile> files;
+    for (const std::string& path : options.files) {
+        MappedFile file;
+        if (open_file(path, file)) {
+            files.push_back(file);
+        } else {
+            close_file(file);
+        }
+    }
+    if (files.empty()) {
+        return 1;
+    }
+
+    // The budget goes to the files in priority order, page aligned
+    size_t page = page_size();
+    size_t left = options.budget ? options.budget : SIZE_MAX;
+    size_t target = 0;
+    std::vector<Chunk> chunks;
+    for (size_t f = 0; f < files.size(); ++f) {
+        MappedFile& file = files[f];
+        file.warm = std::min(file.size, left / page * page);
+        left -= file.warm;
+        target += file.warm;
+        for (size_t offset = 0; offset < file.warm; offset += options.chunk) {
+            chunks.push_back({f, offset, std::min(options.chunk, file.warm - offset)});
+        }
+    }
+
+    init_timer(options.measure);
+    BenchResults results("mmap_prewarm/" + options.method);
+    results.set_path(files[0].path);
+    print_residency("Before:", files);
+
+    int code = 0;
+    if (options.method != "report") {
+        std::vector<double> issue, warm, speeds;
+        size_t loaded = 0;
+        bool ok = measure(options.measure, [&](bool measured) {
+            WarmRun run = warm_once(options, files, chunks, target);
+            if (!run.ok) {
+                std::cerr << options.method << " failed: " << std::strerror(run.err) << "\n";
+                return false;
+            }
+            if (measured) {
+                issue.push_back(run.issue_seconds);
+                warm.push_back(run.resident_seconds);
+                // Nothing to time when the files were already cached (no -e)
+                if (run.loaded > 0) {
+                    speeds.push_back(run.loaded / (1024.0 * 1024.0) / run.resident_seconds);
+                }
+                loaded = run.loaded;
+            }
+            return true;
+        });
+        if (ok) {
+            bool reject = options.measure.reject_outliers;
+            Summary warm_time = summarize(warm, reject);
+            Summary speed = summarize(speeds, reject);
+            std::cout << "Method: " << options.method << " | Threads: " << options.threads
+                      << " | Target: " << (target >> 20) << " MB"
+                      << " | Loaded: " << (loaded >> 20) << " MB"
+                      << " | Issued in: " << summarize(issue, reject).median << " s"
+                      << " | Warm in: " << warm_time << " s";
+            if (!speeds.empty()) {
+                std::cout << " | Throughput: " << speed << " MB/s";
+            }
+            std::cout << "\n";
+            results.add("prewarm", "warm_time", warm_time, "s")
+                .param("threads", options.threads).param("target", target)
+                .param("evict", options.evict);
+            if (!speeds.empty()) {
+                results.add("prewarm", "throughput", speed, "MB/s")
+                    .param("threads", options.threads).param("target", target)
+                    .param("evict", options.evict);
+            }
+        } else {
+            code = 1;
+        }
+        print_residency("After:", files);
+    }
+
+    for (MappedFile& file : files) {
+        close_file(file);
+    }
+    if (code != 0) {
+        return code;
+    }
+    return finish_results(results, options.results);
+}
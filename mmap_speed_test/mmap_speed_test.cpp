@@ -1,25 +1,32 @@
 #include <iostream>
 #include <fstream>
-#include <chrono>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <cstring>
 #include <vector>
 
+#include "bench_results.h"
+
 struct Options {
     int s = 1; // MS_SYNC by default
     int n = 1; // MS_NOCACHE=1 by default
+    MeasureOptions measure;
+    ResultsOptions results;
     bool help = false;
 };
 
 void print_help(const char* program_name) {
-    std::cout << "Usage: " << program_name << " [-s=0|1] [-n=0|1] [-h]\n"
+    std::cout << "Usage: " << program_name << " [-s=0|1] [-n=0|1]\n"
+              << "       [--warmup=N] [--reps=N] [--keep-outliers] [--timer=monotonic|tsc]\n"
+              << "       [--json=FILE] [--csv=FILE] [--compare=FILE] [--threshold=N] [-h]\n"
               << "  -s=0     Use MS_ASYNC\n"
               << "  -s=1     Use MS_SYNC (default)\n"
               << "  -n=0     F_NOCACHE=0\n"
               << "  -n=1     F_NOCACHE=1 (default)\n"
               << "  -h       Show this help message\n";
+    print_measure_help();
+    print_results_help();
 }
 
 Options parse_args(int argc, char* argv[]) {
@@ -42,6 +49,8 @@ Options parse_args(int argc, char* argv[]) {
                 std::cerr << "Invalid value for -n: " << arg << "\n";
                 opts.help = true;
             }
+        } else if (parse_measure_arg(arg, opts.measure)) {
+        } else if (parse_results_arg(arg, opts.results)) {
         } else {
             std::cerr << "Unknown argument: " << arg << "\n";
             opts.help = true;
@@ -53,7 +62,27 @@ Options parse_args(int argc, char* argv[]) {
 
 constexpr size_t BUFFER_SIZE = 1 * 1024 * 1024; // 1 MB
 
-void benchmark(size_t totalSizeMB, bool ms_sync, int f_nocache) {
+// Checksum of the last read pass, printed so the reads are not optimized out
+uint64_t checksum_sink = 0;
+
+// Caching off. F_NOCACHE is macOS-only; elsewhere drop the cached pages instead.
+bool set_nocache(int fd, int f_nocache) {
+#ifdef F_NOCACHE
+    if (fcntl(fd, F_NOCACHE, f_nocache) < 0) {
+        perror("fcntl F_NOCACHE");
+        return false;
+    }
+#else
+    if (f_nocache) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+#endif
+    return true;
+}
+
+// One write+msync and read pass; speeds in MB/s
+bool benchmark_once(size_t totalSizeMB, bool ms_sync, int f_nocache,
+                    double& writeSpeed, double& readSpeed) {
     std::string filename = "test_mmap_file.bin";
     size_t totalSize = totalSizeMB * 1024 * 1024;
 
@@ -61,19 +90,17 @@ void benchmark(size_t totalSizeMB, bool ms_sync, int f_nocache) {
     int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
     if (fd < 0) {
         perror("open");
-        return;
+        return false;
     }
 
-    // Caching off
-    if (fcntl(fd, F_NOCACHE, f_nocache) < 0) {
-        perror("fcntl F_NOCACHE");
+    if (!set_nocache(fd, f_nocache)) {
         exit(1);
     }
 
     if (ftruncate(fd, totalSize) != 0) {
         perror("ftruncate");
         close(fd);
-        return;
+        return false;
     }
 
     // mmap
@@ -81,7 +108,7 @@ void benchmark(size_t totalSizeMB, bool ms_sync, int f_nocache) {
     if (map == MAP_FAILED) {
         perror("mmap");
         close(fd);
-        return;
+        return false;
     }
 
     std::vector<uint8_t> buffer(BUFFER_SIZE);
@@ -90,7 +117,7 @@ void benchmark(size_t totalSizeMB, bool ms_sync, int f_nocache) {
     size_t count = totalSize / BUFFER_SIZE;
 
     // --- Write + msync ---
-    auto writeStart = std::chrono::high_resolution_clock::now();
+    double writeStart = bench_now();
     for (size_t i = 0; i < count; ++i) {
         uint8_t* curr_p = static_cast<uint8_t*>(map) + i * BUFFER_SIZE;
         std::memcpy(curr_p, buffer.data(), BUFFER_SIZE);
@@ -100,7 +127,7 @@ void benchmark(size_t totalSizeMB, bool ms_sync, int f_nocache) {
         }
     }
 
-    auto writeEnd = std::chrono::high_resolution_clock::now();
+    double writeEnd = bench_now();
     munmap(map, totalSize);
     close(fd);
 
@@ -109,12 +136,10 @@ void benchmark(size_t totalSizeMB, bool ms_sync, int f_nocache) {
     fd = open(filename.c_str(), O_RDWR, 0644);
     if (fd < 0) {
         perror("open");
-        return;
+        return false;
     }
 
-    // Caching off
-    if (fcntl(fd, F_NOCACHE, f_nocache) < 0) {
-        perror("fcntl F_NOCACHE");
+    if (!set_nocache(fd, f_nocache)) {
         exit(1);
     }
 
@@ -123,31 +148,60 @@ void benchmark(size_t totalSizeMB, bool ms_sync, int f_nocache) {
     if (map == MAP_FAILED) {
         perror("mmap");
         close(fd);
-        return;
+        return false;
     }
 
     uint64_t checksum = 0;
-    auto readStart = std::chrono::high_resolution_clock::now();
+    double readStart = bench_now();
     for (size_t i = 0; i < count; ++i) {
         uint8_t* ptr = static_cast<uint8_t*>(map) + i * BUFFER_SIZE;
         for (size_t j = 0; j < BUFFER_SIZE; ++j) {
             checksum += ptr[j];
         }
     }
-    auto readEnd = std::chrono::high_resolution_clock::now();
+    double readEnd = bench_now();
 
     // Time and speed
-    auto writeTime = std::chrono::duration<double>(writeEnd - writeStart).count();
-    auto readTime = std::chrono::duration<double>(readEnd - readStart).count();
-
-    std::cout << "Size: " << totalSizeMB << " MB\n";
-    std::cout << "Write+msync: " << (totalSize / (1024.0 * 1024.0)) / writeTime << " MB/s\n";
-    std::cout << "Read       : " << (totalSize / (1024.0 * 1024.0)) / readTime << " MB/s\n";
-    std::cout << "Checksum   : " << checksum << "\n\n";
+    double writeTime = writeEnd - writeStart;
+    double readTime = readEnd - readStart;
+    writeSpeed = (totalSize / (1024.0 * 1024.0)) / writeTime;
+    readSpeed = (totalSize / (1024.0 * 1024.0)) / readTime;
+    checksum_sink = checksum;
 
     munmap(map, totalSize);
     close(fd);
     unlink(filename.c_str());
+    return true;
+}
+
+void benchmark(size_t totalSizeMB, bool ms_sync, int f_nocache,
+               const MeasureOptions& measure_opts, BenchResults& results) {
+    std::vector<double> writeSpeeds, readSpeeds;
+    bool ok = measure(measure_opts, [&](bool measured) {
+        double writeSpeed = 0, readSpeed = 0;
+        if (!benchmark_once(totalSizeMB, ms_sync, f_nocache, writeSpeed, readSpeed)) {
+            return false;
+        }
+        if (measured) {
+            writeSpeeds.push_back(writeSpeed);
+            readSpeeds.push_back(readSpeed);
+        }
+        return true;
+    });
+    if (!ok) {
+        return;
+    }
+    Summary writeSpeed = summarize(writeSpeeds, measure_opts.reject_outliers);
+    Summary readSpeed = summarize(readSpeeds, measure_opts.reject_outliers);
+
+    std::cout << "Size: " << totalSizeMB << " MB\n";
+    std::cout << "Write+msync: " << writeSpeed << " MB/s\n";
+    std::cout << "Read       : " << readSpeed << " MB/s\n";
+    std::cout << "Checksum   : " << checksum_sink << "\n\n";
+    results.add("mmap", "write_msync", writeSpeed, "MB/s")
+        .param("size_mb", totalSizeMB).param("ms_sync", ms_sync).param("nocache", f_nocache);
+    results.add("mmap", "read", readSpeed, "MB/s")
+        .param("size_mb", totalSizeMB).param("ms_sync", ms_sync).param("nocache", f_nocache);
 }
 
 int main(int argc, char* argv[]) {
@@ -163,8 +217,11 @@ int main(int argc, char* argv[]) {
     std::vector<size_t> sizes = {100, 512, 1024, 2048, 4096, 8192
         //, 12288
         };
+    init_timer(options.measure);
+    BenchResults results("mmap_speed_test");
+    results.set_path(".");
     for (size_t sz : sizes) {
-        benchmark(sz, options.s, options.n);
+        benchmark(sz, options.s, options.n, options.measure, results);
     }
-    return 0;
+    return finish_results(results, options.results);
 }
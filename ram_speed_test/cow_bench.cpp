@@ -0,0 +1,237 @@
+#include "cow_bench.h"
+#include "bench_results.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+constexpr size_t HUGE_PAGE = 2ULL << 20;
+
+struct CowRun {
+    bool ok = true;
+    std::string failure;
+    double fork_seconds = 0;
+    double rewrite_seconds = 0;       // with the child holding the buffer
+    double baseline_seconds = 0;      // the same rewrite without a child
+    size_t huge_kb = 0;               // AnonHugePages of the process before fork
+    std::vector<float> page_ns;       // latency of the first write to every page after fork
+};
+
+// AnonHugePages of the whole process in KB, 0 when unknown
+size_t anon_huge_kb() {
+    std::ifstream in("/proc/self/smaps_rollup");
+    std::string key;
+    size_t value = 0;
+    while (in >> key) {
+        if (key == "AnonHugePages:") {
+            in >> value;
+            return value;
+        }
+        in.ignore(1 << 16, '\n');
+    }
+    return 0;
+}
+
+// Applies the page mode to the mapping; returns false when the host lacks it
+bool apply_page_mode(char* buf, size_t size, const std::string& mode, std::string& failure) {
+    int advice = -1;
+    if (mode == "thp") {
+#ifdef MADV_HUGEPAGE
+        advice = MADV_HUGEPAGE;
+#endif
+    } else {
+        // Keep the other modes on 4 KB pages, so only the fork behaviour differs
+#ifdef MADV_NOHUGEPAGE
+        madvise(buf, size, MADV_NOHUGEPAGE);
+#endif
+        if (mode == "4k") {
+            return true;
+        } else if (mode == "dontfork") {
+#ifdef MADV_DONTFORK
+            advice = MADV_DONTFORK;
+#endif
+        } else if (mode == "wipeonfork") {
+#ifdef MADV_WIPEONFORK
+            advice = MADV_WIPEONFORK;
+#endif
+        }
+    }
+    if (advice < 0) {
+        failure = "not supported on this system";
+        return false;
+    }
+    if (madvise(buf, size, advice) != 0) {
+        failure = std::string("madvise: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// Writes one word to every page with `threads` threads, each over its own
+// slice; the per-page latency goes to `page_ns` when it is not null
+double rewrite(char* buf, size_t pages, size_t page, int threads, uint64_t pattern,
+               std::vector<float>* page_ns) {
+    std::vector<std::thread> workers;
+    double start = bench_now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([=]() {
+            size_t first = pages * t / threads;
+            size_t last = pages * (t + 1) / threads;
+            for (size_t i = first; i < last; ++i) {
+                double page_start = bench_now();
+                *reinterpret_cast<volatile uint64_t*>(buf + i * page) = pattern ^ i;
+                if (page_ns != nullptr) {
+                    (*page_ns)[i] = static_cast<float>((bench_now() - page_start) * 1e9);
+                }
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    return bench_now() - start;
+}
+
+CowRun cow_once(size_t size, const std::string& mode, int threads) {
+    CowRun run;
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t pages = size / page;
+    // Huge pages need a 2 MB aligned range
+    size_t mapped = size + HUGE_PAGE;
+    void* raw = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        run.ok = false;
+        run.failure = std::string("mmap: ") + std::strerror(errno);
+        return run;
+    }
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+    char* buf = reinterpret_cast<char*>(aligned);
+    if (!apply_page_mode(buf, size, mode, run.failure)) {
+        run.ok = false;
+        munmap(raw, mapped);
+        return run;
+    }
+    memset(buf, 0xAA, size);
+    run.huge_kb = anon_huge_kb();
+    // Every page is resident and writable: the plain cost of the rewrite loop
+    std::vector<float> page_ns(pages);
+    run.baseline_seconds = rewrite(buf, pages, page, threads, 0x1111, &page_ns);
+
+    int hold[2];
+    if (pipe(hold) != 0) {
+        run.ok = false;
+        run.failure = std::string("pipe: ") + std::strerror(errno);
+        munmap(raw, mapped);
+        return run;
+    }
+    double start = bench_now();
+    pid_t pid = fork();
+    run.fork_seconds = bench_now() - start;
+    if (pid == 0) {
+        // The child keeps its view of the buffer until the parent closes the pipe
+        close(hold[1]);
+        char c;
+        while (read(hold[0], &c, 1) < 0 && errno == EINTR) {
+        }
+        _exit(0);
+    }
+    close(hold[0]);
+    if (pid < 0) {
+        run.ok = false;
+        run.failure = std::string("fork: ") + std::strerror(errno);
+        close(hold[1]);
+        munmap(raw, mapped);
+        return run;
+    }
+
+    run.rewrite_seconds = rewrite(buf, pages, page, threads, 0x2222, &page_ns);
+    run.page_ns = std::move(page_ns);
+
+    close(hold[1]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    munmap(raw, mapped);
+    return run;
+}
+
+} // namespace
+
+void run_cow_benchmark(const CowOptions& opts, const MeasureOptions& measure_opts,
+                       BenchResults& results) {
+    std::vector<size_t> sizes;
+    for (size_t size = 64ULL << 20; size < opts.max_size; size *= 2) {
+        sizes.push_back(size);
+    }
+    sizes.push_back(opts.max_size);
+    int threads = std::max(1, opts.threads);
+    std::cout << "Rewriting threads: " << threads
+              << " | Page: " << sysconf(_SC_PAGESIZE) << " B\n";
+
+    bool reject = measure_opts.reject_outliers;
+    for (const std::string& mode : opts.page_modes) {
+        for (size_t size : sizes) {
+            std::vector<double> fork_ms, cow_mbs, base_mbs, p50_us, p99_us, max_us;
+            size_t huge_kb = 0;
+            CowRun failed;
+            measure(measure_opts, [&](bool measured) {
+                CowRun run = cow_once(size, mode, threads);
+                if (!run.ok) {
+                    failed = run;
+                    return false;
+                }
+                if (measured) {
+                    double mb = size / (1024.0 * 1024.0);
+                    fork_ms.push_back(run.fork_seconds * 1e3);
+                    cow_mbs.push_back(mb / run.rewrite_seconds);
+                    base_mbs.push_back(mb / run.baseline_seconds);
+                    std::sort(run.page_ns.begin(), run.page_ns.end());
+                    p50_us.push_back(percentile(run.page_ns, 50) / 1e3);
+                    p99_us.push_back(percentile(run.page_ns, 99) / 1e3);
+                    max_us.push_back(percentile(run.page_ns, 100) / 1e3);
+                    huge_kb = run.huge_kb;
+                }
+                return true;
+            });
+
+            std::cout << "Pages: " << mode << " | Size: " << (size >> 20) << " MB | ";
+            if (!failed.ok) {
+                std::cout << failed.failure << "\n";
+                break;
+            }
+            Summary fork_time = summarize(fork_ms, reject);
+            Summary cow = summarize(cow_mbs, reject);
+            Summary p50 = summarize(p50_us, reject);
+            Summary p99 = summarize(p99_us, reject);
+            std::cout << "fork: " << fork_time << " ms"
+                      << " | Rewrite after fork: " << cow << " MB/s"
+                      << " | Page p50: " << p50.median << " us"
+                      << " | p99: " << p99.median << " us"
+                      << " | max: " << summarize(max_us, reject).median << " us"
+                      << " | Without child: " << summarize(base_mbs, reject).median << " MB/s";
+            if (mode == "thp") {
+                std::cout << " | AnonHugePages: " << (huge_kb >> 10) << " MB";
+            }
+            std::cout << "\n";
+
+            auto add = [&](const std::string& name, const std::string& metric,
+                           const Summary& s, const std::string& unit) {
+                results.add(name, metric, s, unit)
+                    .param("pages", mode).param("size", size).param("threads", threads);
+            };
+            add("fork", "latency", fork_time, "ms");
+            add("cow", "throughput", cow, "MB/s");
+            add("cow", "page_p50", p50, "us");
+            add("cow", "page_p99", p99, "us");
+        }
+    }
+}
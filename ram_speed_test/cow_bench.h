@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class BenchResults;
+struct MeasureOptions;
+
+struct CowOptions {
+    size_t max_size = 1ULL << 30;  // the largest buffer; sizes double from 64 MB up to it
+    int threads = 1;               // parent threads rewriting the buffer after fork
+    // How the buffer is mapped: 4k, thp, dontfork, wipeonfork
+    std::vector<std::string> page_modes = {"4k", "thp", "dontfork", "wipeonfork"};
+};
+
+// Cost of forking a process that holds a large resident buffer: the fork()
+// latency against the buffer size, then the copy-on-write fault throughput
+// and per-page latency while the parent rewrites the buffer and the child
+// still holds it, next to the same rewrite without a child. The buffer is
+// mapped with 4 KB pages, transparent huge pages, MADV_DONTFORK or
+// MADV_WIPEONFORK.
+void run_cow_benchmark(const CowOptions& opts, const MeasureOptions& measure_opts,
+                       BenchResults& results);
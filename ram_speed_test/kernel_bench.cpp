@@ -0,0 +1,131 @@
+#include "kernel_bench.h"
+#include "kernels.h"
+#include "bench_results.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+// Checksums of the kernels, printed so the work is not optimized out
+uint64_t checksum_sink = 0;
+
+// One run of `kernel` on all threads; returns the total speed in MB/s
+double run_threads(const KernelInfo& kernel, const std::vector<uint8_t*>& buffers,
+                   size_t buffer_size, int iterations) {
+    std::vector<std::thread> threads;
+    std::vector<double> speeds(buffers.size(), 0.0);
+    std::vector<uint64_t> sums(buffers.size(), 0);
+    for (size_t t = 0; t < buffers.size(); ++t) {
+        threads.emplace_back([&, t]() {
+            double start = bench_now();
+            sums[t] = kernel.fn(buffers[t], buffer_size, iterations);
+            double seconds = bench_now() - start;
+            speeds[t] = kernel.bytes(buffer_size) * static_cast<double>(iterations) /
+                        (1024.0 * 1024.0 * seconds);
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    double total = 0.0;
+    for (size_t t = 0; t < buffers.size(); ++t) {
+        total += speeds[t];
+        checksum_sink ^= sums[t];
+    }
+    return total;
+}
+
+} // namespace
+
+void print_kernel_list() {
+    for (const KernelInfo& kernel : KERNELS) {
+        if (kernel_supported(kernel)) {
+            std::cout << kernel_name(kernel) << "\n";
+        }
+    }
+}
+
+bool run_kernel_benchmark(const KernelOptions& opts, const MeasureOptions& measure_opts,
+                          BenchResults& results) {
+    std::vector<const KernelInfo*> selected;
+    for (const std::string& name : opts.names) {
+        bool found = false;
+        bool unsupported = false;
+        for (const KernelInfo& kernel : KERNELS) {
+            if (name == "all" || kernel_name(kernel) == name) {
+                // Kernels this CPU cannot run are left out of "all"
+                if (kernel_supported(kernel)) {
+                    selected.push_back(&kernel);
+                    found = true;
+                } else {
+                    unsupported = name != "all";
+                }
+            }
+        }
+        if (unsupported) {
+            std::cerr << "Kernel " << name << " needs AVX2, which this CPU lacks" << std::endl;
+            return false;
+        }
+        if (!found) {
+            std::cerr << "Unknown kernel: " << name << " (-k=list prints the names)" << std::endl;
+            return false;
+        }
+    }
+
+    // 64-byte aligned buffers with room for the misaligned kernels, first
+    // touched by the thread that uses them
+    int num_threads = std::max(1, opts.threads);
+    std::vector<uint8_t*> buffers(num_threads, nullptr);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            void* p = nullptr;
+            if (posix_memalign(&p, 64, opts.buffer_size + 64) == 0) {
+                std::memset(p, 0xAA, opts.buffer_size + 64);
+                buffers[t] = static_cast<uint8_t*>(p);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    bool allocated = true;
+    for (uint8_t* p : buffers) {
+        allocated = allocated && p != nullptr;
+    }
+
+    if (allocated) {
+        std::cout << "Running with " << num_threads << " thread(s), "
+                  << (opts.buffer_size >> 20) << " MB buffer per thread, "
+                  << opts.iterations << " iteration(s)" << std::endl;
+        for (const KernelInfo* kernel : selected) {
+            std::vector<double> speeds;
+            measure(measure_opts, [&](bool measured) {
+                double speed = run_threads(*kernel, buffers, opts.buffer_size, opts.iterations);
+                if (measured) {
+                    speeds.push_back(speed);
+                }
+                return true;
+            });
+            Summary speed = summarize(speeds, measure_opts.reject_outliers);
+            std::string name = kernel_name(*kernel);
+            std::cout << "Kernel: " << name << " | Width: " << kernel->width << " B"
+                      << " | Unroll: " << kernel->unroll << " | Op: " << kernel_op_name(kernel->op)
+                      << " | Offset: " << kernel->offset << " | Speed: " << speed << " MB/s"
+                      << std::endl;
+            results.add(name, "bandwidth", speed, "MB/s")
+                .param("threads", num_threads).param("buffer_size", opts.buffer_size);
+        }
+        std::cout << "Checksum (ignore): " << checksum_sink << std::endl;
+    } else {
+        std::cerr << "Memory allocation failed." << std::endl;
+    }
+
+    for (uint8_t* p : buffers) {
+        free(p);
+    }
+    return allocated;
+}
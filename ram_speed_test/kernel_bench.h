@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class BenchResults;
+struct MeasureOptions;
+
+struct KernelOptions {
+    std::vector<std::string> names = {"all"};  // kernels to run, "all" for every one
+    int threads = 1;                           // threads, each with its own buffer
+    size_t buffer_size = 1ULL << 30;           // buffer per thread
+    int iterations = 10;                       // passes over the buffer per run
+};
+
+// Print the names of the compiled kernels (see kernels.h)
+void print_kernel_list();
+
+// Runs the selected kernels on every thread's buffer and prints the total
+// bandwidth of each; returns false when a name is unknown
+bool run_kernel_benchmark(const KernelOptions& opts, const MeasureOptions& measure_opts,
+                          BenchResults& results);
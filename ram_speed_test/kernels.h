@@ -0,0 +1,195 @@
+#pragma once
+
+// Memory kernels generated from templates. Every combination of element
+// width, unroll factor, operation and alignment is a separate instantiation,
+// so the compiler sees the loop shape as constants, and all of them are
+// collected into KERNELS at compile time. kernel_name() gives the name a
+// kernel is selected by at runtime, e.g. "read_64_x8_aligned".
+//
+// The 256-bit kernels exist on x86 only. They are compiled for AVX2 whatever
+// the build flags are, and kernel_supported() tells whether the CPU runs them.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+enum class KernelOp { Read, Write, Rmw };
+
+// Runs the kernel `iterations` times over `size` bytes at `base` (64-byte
+// aligned, with at least 64 bytes of slack after `size`); returns a value
+// derived from the data so the reads are not optimized out
+using KernelFn = uint64_t (*)(uint8_t* base, size_t size, int iterations);
+
+struct KernelInfo {
+    size_t width;    // bytes per access
+    int unroll;      // accesses per loop iteration, each with its own accumulator
+    KernelOp op;
+    size_t offset;   // bytes from the 64-byte aligned base; 1 misaligns the accesses
+    KernelFn fn;
+    bool avx2;       // needs a CPU with AVX2
+
+    // Bytes one iteration over a `size` byte buffer touches
+    size_t bytes(size_t size) const {
+        return size / (width * unroll) * (width * unroll);
+    }
+};
+
+#if defined(__GNUC__)
+// SSE and AVX register sized elements
+typedef uint64_t v128 __attribute__((vector_size(16)));
+typedef uint64_t v256 __attribute__((vector_size(32)));
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_HAVE_AVX2 1
+#endif
+#endif
+
+namespace kernel_detail {
+
+// Unaligned-safe access; compiles to a plain load/store of the element
+// Output parameter rather than a return value: returning the AVX sized
+// vectors by value changes the ABI without -mavx. Always inlined, so the
+// AVX2 kernels get AVX2 code for them.
+template <typename T>
+__attribute__((always_inline)) inline void load(const uint8_t* p, T& v) {
+    std::memcpy(&v, p, sizeof(T));
+}
+
+template <typename T>
+__attribute__((always_inline)) inline void store(uint8_t* p, const T& v) {
+    std::memcpy(p, &v, sizeof(T));
+}
+
+template <typename T>
+__attribute__((always_inline)) inline uint64_t fold(const T& v) {
+    uint64_t r = 0;
+    std::memcpy(&r, &v, sizeof(T) < sizeof(r) ? sizeof(T) : sizeof(r));
+    return r;
+}
+
+template <typename T, int Unroll, KernelOp Op, size_t Offset>
+__attribute__((always_inline)) inline uint64_t kernel_loop(uint8_t* base, size_t size,
+                                                           int iterations) {
+    constexpr size_t step = sizeof(T) * Unroll;
+    uint8_t* buf = base + Offset;
+    size_t end = size / step * step;
+    T acc[Unroll] = {};
+    T one = {};
+    one += 1;
+    for (int it = 0; it < iterations; ++it) {
+        for (size_t i = 0; i < end; i += step) {
+            for (int u = 0; u < Unroll; ++u) {
+                uint8_t* p = buf + i + u * sizeof(T);
+                if constexpr (Op == KernelOp::Write) {
+                    store(p, acc[u]);
+                } else {
+                    T v;
+                    load(p, v);
+                    if constexpr (Op == KernelOp::Read) {
+                        acc[u] ^= v;
+                    } else {
+                        v += one;
+                        store(p, v);
+                    }
+                }
+            }
+        }
+        // Vary the written value between iterations
+        for (int u = 0; u < Unroll; ++u) {
+            acc[u] += one;
+        }
+    }
+    uint64_t result = 0;
+    for (int u = 0; u < Unroll; ++u) {
+        result ^= fold(acc[u]);
+    }
+    return result ^ buf[0];
+}
+
+} // namespace kernel_detail
+
+template <typename T, int Unroll, KernelOp Op, size_t Offset>
+uint64_t run_kernel(uint8_t* base, size_t size, int iterations) {
+    return kernel_detail::kernel_loop<T, Unroll, Op, Offset>(base, size, iterations);
+}
+
+#ifdef KERNELS_HAVE_AVX2
+template <typename T, int Unroll, KernelOp Op, size_t Offset>
+__attribute__((target("avx2"))) uint64_t run_kernel_avx2(uint8_t* base, size_t size,
+                                                         int iterations) {
+    return kernel_detail::kernel_loop<T, Unroll, Op, Offset>(base, size, iterations);
+}
+#endif
+
+namespace kernel_detail {
+
+template <typename T, int Unroll, KernelOp Op, size_t Offset>
+constexpr KernelInfo entry() {
+#ifdef KERNELS_HAVE_AVX2
+    if constexpr (sizeof(T) == 32) {
+        return {sizeof(T), Unroll, Op, Offset, &run_kernel_avx2<T, Unroll, Op, Offset>, true};
+    } else {
+        return {sizeof(T), Unroll, Op, Offset, &run_kernel<T, Unroll, Op, Offset>, false};
+    }
+#else
+    return {sizeof(T), Unroll, Op, Offset, &run_kernel<T, Unroll, Op, Offset>, false};
+#endif
+}
+
+template <size_t A, size_t B>
+constexpr std::array<KernelInfo, A + B> join(const std::array<KernelInfo, A>& a,
+                                             const std::array<KernelInfo, B>& b) {
+    std::array<KernelInfo, A + B> all = {};
+    for (size_t i = 0; i < A; ++i) all[i] = a[i];
+    for (size_t i = 0; i < B; ++i) all[A + i] = b[i];
+    return all;
+}
+
+template <typename T, KernelOp Op, size_t Offset>
+constexpr std::array<KernelInfo, 4> unrolls() {
+    return {{entry<T, 1, Op, Offset>(), entry<T, 2, Op, Offset>(),
+             entry<T, 4, Op, Offset>(), entry<T, 8, Op, Offset>()}};
+}
+
+template <typename T, size_t Offset>
+constexpr auto ops() {
+    return join(join(unrolls<T, KernelOp::Read, Offset>(), unrolls<T, KernelOp::Write, Offset>()),
+                unrolls<T, KernelOp::Rmw, Offset>());
+}
+
+template <size_t Offset>
+constexpr auto widths() {
+    auto scalar = join(join(ops<uint8_t, Offset>(), ops<uint32_t, Offset>()), ops<uint64_t, Offset>());
+#if defined(KERNELS_HAVE_AVX2)
+    return join(scalar, join(ops<v128, Offset>(), ops<v256, Offset>()));
+#elif defined(__GNUC__)
+    return join(scalar, ops<v128, Offset>());
+#else
+    return scalar;
+#endif
+}
+
+} // namespace kernel_detail
+
+// Every kernel: widths x operations x unroll 1/2/4/8, aligned and off by one byte
+inline constexpr auto KERNELS = kernel_detail::join(kernel_detail::widths<0>(),
+                                                    kernel_detail::widths<1>());
+
+// Whether this CPU can run the kernel
+inline bool kernel_supported(const KernelInfo& k) {
+#ifdef KERNELS_HAVE_AVX2
+    return !k.avx2 || __builtin_cpu_supports("avx2");
+#else
+    return !k.avx2;
+#endif
+}
+
+inline const char* kernel_op_name(KernelOp op) {
+    return op == KernelOp::Read ? "read" : op == KernelOp::Write ? "write" : "rmw";
+}
+
+inline std::string kernel_name(const KernelInfo& k) {
+    return std::string(kernel_op_name(k.op)) + "_" + std::to_string(k.width * 8) + "_x" + std::to_string(k.unroll) +
+           (k.offset ? "_off" + std::to_string(k.offset) : "_aligned");
+}
@@ -1,66 +1,124 @@
 #include <iostream>
 #include <vector>
 #include <thread>
-#include <chrono>
 #include <cstring>
 #include <cstdlib>
 #include <cstdint>
 #include <atomic>
 #include <mutex>
-#include <regex>
+
+#include "bench_results.h"
+#include "parse_size.h"
+#include "uffd_bench.h"
+#include "cow_bench.h"
+#include "kernel_bench.h"
 
 using namespace std;
-using namespace chrono;
+
+struct Options {
+    string mode = "seq";
+    int num_threads = 1;
+    size_t buffer_size = 1ULL << 30; // 1GB
+    int num_iterations = 10;
+    vector<int> prefetch = UffdOptions().prefetch;
+    string source_path;
+    vector<string> page_modes = CowOptions().page_modes;
+    vector<string> kernels = KernelOptions().names;
+    MeasureOptions measure;
+    ResultsOptions results;
+};
 
 //print usage information
 void print_usage() {
     std::cout << "Usage:\n"
-    << "  -jN       Number of threads to run concurrently (default: 1)\n"
+    << "  -m=seq    Sequential write/read of a buffer per thread (default)\n"
+    << "  -m=uffd   Lazy paging: faults of a userfaultfd region served from user space\n"
+    << "            with UFFDIO_COPY, vs kernel zero-fill faults (Linux)\n"
+    << "  -m=fork   fork() latency and copy-on-write faults of the parent rewriting\n"
+    << "            a resident buffer while the child holds it\n"
+    << "  -m=kernel Template generated kernels over width, unroll, operation and alignment\n"
+    << "  -jN       Number of threads to run concurrently (default: 1);\n"
+    << "            -m=uffd runs 1, 2, 4 .. N faulting threads\n"
     << "  -b=N[KMG] Buffer size with optional unit (K, M, or G). Default is 1G.\n"
-    << "  -nN       Number of iterations to perform (default: 10)\n";
+    << "            -m=uffd: size of the lazily populated region\n"
+    << "            -m=fork: the largest buffer, sizes double from 64M up to it\n"
+    << "  -nN       Number of iterations to perform (default: 10)\n"
+    << "  -a=N,...  Pages filled per fault for -m=uffd (default: 1,16)\n"
+    << "  -f=path   File the -m=uffd pages are filled from (default: a buffer)\n"
+    << "  -p=M,...  Page modes for -m=fork: 4k, thp, dontfork, wipeonfork (default: all)\n"
+    << "  -k=NAME,...|list|all  Kernels for -m=kernel, e.g. read_64_x8_aligned;\n"
+    << "            list prints the names (default: all)\n";
+    print_measure_help();
+    print_results_help();
 }
 
-// Parse buffer size string with suffix (e.g., "2G", "512M", "128K")
-size_t parse_size(const string& str) {
-    regex re(R"(^(\d+)([KMG]?)$)", regex::icase);
-    smatch match;
-    if (!regex_match(str, match, re)) {
-        //throw invalid_argument("Invalid buffer size format.");
-        throw invalid_argument("");
+// Split a comma separated list
+vector<string> split_list(const string& list) {
+    vector<string> items;
+    for (size_t pos = 0; pos <= list.size();) {
+        size_t comma = min(list.find(',', pos), list.size());
+        items.push_back(list.substr(pos, comma - pos));
+        pos = comma + 1;
     }
-    size_t base = stoull(match[1]);
-    string suffix = match[2].str();
-    if (suffix == "K" || suffix == "k") return base * (1ULL << 10);
-    if (suffix == "M" || suffix == "m") return base * (1ULL << 20);
-    if (suffix == "G" || suffix == "g") return base * (1ULL << 30);
-    return base;
+    return items;
 }
 // Command-line argument parser
-std::tuple<int, int, size_t> parse_args(int argc, char* argv[]) {
-    int num_threads = 1;
-    size_t buffer_size = 1ULL << 30; // 1GB
-    int num_iterations = 10;
+Options parse_args(int argc, char* argv[]) {
+    Options opts;
 
     for (int i = 1; i < argc; ++i) {
         string arg = argv[i];
-        if (arg.rfind("-j", 0) == 0) {
-            num_threads = stoi(arg.substr(2));
+        if (parse_measure_arg(arg, opts.measure) || parse_results_arg(arg, opts.results)) {
+            continue;
+        }
+        if (arg.rfind("-m=", 0) == 0) {
+            opts.mode = arg.substr(3);
+            if (opts.mode != "seq" && opts.mode != "uffd" && opts.mode != "fork" &&
+                opts.mode != "kernel") {
+                cerr << "Unknown mode: " << opts.mode << endl;
+                goto exit;
+            }
+        } else if (arg.rfind("-j", 0) == 0) {
+            opts.num_threads = stoi(arg.substr(2));
         } else if (arg.rfind("-b=", 0) == 0) {
             try {
-                buffer_size = parse_size(arg.substr(3));
+                opts.buffer_size = parse_size(arg.substr(3));
             }
             catch(...) {
                 cerr << "Invalid buffer size format." << endl;
                 goto exit;
             }
         } else if (arg.rfind("-n", 0) == 0) {
-            num_iterations = stoi(arg.substr(2));
+            opts.num_iterations = stoi(arg.substr(2));
+        } else if (arg.rfind("-a=", 0) == 0) {
+            opts.prefetch.clear();
+            for (const string& item : split_list(arg.substr(3))) {
+                try {
+                    opts.prefetch.push_back(stoi(item));
+                }
+                catch(...) {
+                    cerr << "Invalid page count: " << arg << endl;
+                    goto exit;
+                }
+            }
+        } else if (arg.rfind("-f=", 0) == 0) {
+            opts.source_path = arg.substr(3);
+        } else if (arg.rfind("-k=", 0) == 0) {
+            opts.kernels = split_list(arg.substr(3));
+        } else if (arg.rfind("-p=", 0) == 0) {
+            opts.page_modes = split_list(arg.substr(3));
+            for (const string& mode : opts.page_modes) {
+                if (mode != "4k" && mode != "thp" && mode != "dontfork" && mode != "wipeonfork") {
+                    cerr << "Unknown page mode: " << mode << endl;
+                    goto exit;
+                }
+            }
         } else {
             cerr << "Unknown argument: " << arg << endl;
             goto exit;
         }
     }
-    return {num_threads, num_iterations, buffer_size};
+    return opts;
     exit:
     print_usage();
     exit(1);
@@ -77,19 +135,18 @@ void ram_test(int thread_id, size_t buffer_size, int iterations,
     }
     uint8_t* test_buf = static_cast<uint8_t*>(buf_ptr);
     memset(test_buf, 0xAA, buffer_size);
-    auto start_write = high_resolution_clock::now();
+    double start_write = bench_now();
     for (int i = 0; i < iterations; ++i) {
         for (size_t j = 0; j < buffer_size; ++j) {
             test_buf[j] = static_cast<uint8_t>(j);
         }
     }
-    auto end_write = high_resolution_clock::now();
-    double write_time = duration<double>(end_write - start_write).count();
+    double write_time = bench_now() - start_write;
     write_speed_out = (buffer_size * iterations) / (1024.0 * 1024.0 * write_time);
     // Sequential block reading test
     memset(test_buf, 0x55, buffer_size);
     volatile uint8_t sink = 0;
-    auto start_read = high_resolution_clock::now();
+    double start_read = bench_now();
     for (int i = 0; i < iterations; ++i) {
         for (size_t j = 0; j < buffer_size; j += 64) {
             uint64_t* ptr = reinterpret_cast<uint64_t*>(&test_buf[j]);
@@ -98,8 +155,7 @@ void ram_test(int thread_id, size_t buffer_size, int iterations,
             );
         }
     }
-    auto end_read = high_resolution_clock::now();
-    double read_time = duration<double>(end_read - start_read).count();
+    double read_time = bench_now() - start_read;
     read_speed_out = (buffer_size * iterations) / (1024.0 * 1024.0 * read_time);
     // in case of "sink" is optimized out and the test shows wrong (too high) values,
     // use "sink" for output the following:
@@ -107,13 +163,9 @@ void ram_test(int thread_id, size_t buffer_size, int iterations,
     free(buf_ptr);
 }
 
-int main(int argc, char* argv[]) {
-    auto [num_threads, num_iterations, buffer_size] = parse_args(argc, argv);
-
-    cout << "Running with " << num_threads << " thread(s), "
-         << (buffer_size >> 20) << " MB buffer per thread, "
-         << num_iterations << " iteration(s)" << endl;
-
+// All threads once; returns the total write and read speed in MB/s
+void run_threads(int num_threads, size_t buffer_size, int num_iterations,
+                 double& total_write, double& total_read) {
     vector<thread> threads;
     vector<double> write_speeds(num_threads, 0.0);
     vector<double> read_speeds(num_threads, 0.0);
@@ -127,15 +179,84 @@ int main(int argc, char* argv[]) {
         t.join();
     }
 
-    double total_write = 0.0, total_read = 0.0;
+    total_write = 0.0;
+    total_read = 0.0;
     for (int i = 0; i < num_threads; ++i) {
         total_write += write_speeds[i];
         total_read += read_speeds[i];
     }
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parse_args(argc, argv);
+    init_timer(options.measure);
+
+    if (options.mode == "uffd") {
+        UffdOptions uffd;
+        uffd.region_size = options.buffer_size;
+        uffd.max_threads = options.num_threads;
+        uffd.prefetch = options.prefetch;
+        uffd.source_path = options.source_path;
+        BenchResults results("ram_speed_test/uffd");
+        run_uffd_benchmark(uffd, options.measure, results);
+        return finish_results(results, options.results);
+    }
+    if (options.mode == "fork") {
+        CowOptions cow;
+        cow.max_size = options.buffer_size;
+        cow.threads = options.num_threads;
+        cow.page_modes = options.page_modes;
+        BenchResults results("ram_speed_test/fork");
+        run_cow_benchmark(cow, options.measure, results);
+        return finish_results(results, options.results);
+    }
+    if (options.mode == "kernel") {
+        if (options.kernels.size() == 1 && options.kernels[0] == "list") {
+            print_kernel_list();
+            return 0;
+        }
+        KernelOptions kernels;
+        kernels.names = options.kernels;
+        kernels.threads = options.num_threads;
+        kernels.buffer_size = options.buffer_size;
+        kernels.iterations = options.num_iterations;
+        BenchResults results("ram_speed_test/kernel");
+        if (!run_kernel_benchmark(kernels, options.measure, results)) {
+            return 1;
+        }
+        return finish_results(results, options.results);
+    }
+
+    int num_threads = options.num_threads;
+    size_t buffer_size = options.buffer_size;
+    int num_iterations = options.num_iterations;
+    const MeasureOptions& measure_options = options.measure;
+
+    cout << "Running with " << num_threads << " thread(s), "
+         << (buffer_size >> 20) << " MB buffer per thread, "
+         << num_iterations << " iteration(s)" << endl;
+
+    vector<double> write_totals, read_totals;
+    measure(measure_options, [&](bool measured) {
+        double total_write = 0.0, total_read = 0.0;
+        run_threads(num_threads, buffer_size, num_iterations, total_write, total_read);
+        if (measured) {
+            write_totals.push_back(total_write);
+            read_totals.push_back(total_read);
+        }
+        return true;
+    });
+    Summary total_write = summarize(write_totals, measure_options.reject_outliers);
+    Summary total_read = summarize(read_totals, measure_options.reject_outliers);
 
     cout << "\n=== Aggregate Results ===" << endl;
     cout << "Total Write Speed: " << total_write << " MB/s" << endl;
     cout << "Total Read Speed:  " << total_read  << " MB/s" << endl;
 
-    return 0;
+    BenchResults results("ram_speed_test");
+    results.add("sequential", "write", total_write, "MB/s")
+        .param("threads", num_threads).param("buffer_size", buffer_size);
+    results.add("sequential", "read", total_read, "MB/s")
+        .param("threads", num_threads).param("buffer_size", buffer_size);
+    return finish_results(results, options.results);
 }
@@ -0,0 +1,473 @@
+#include "uffd_bench.h"
+#include "bench_results.h"
+
+#include <iostream>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// UFFDIO_COPY attempts in a row that may fail with EAGAIN and copy nothing
+constexpr int MAX_COPY_RETRIES = 1000;
+
+struct FaultRun {
+    bool ok = true;
+    std::string failure;
+    double seconds = 0;
+    size_t faults = 0;         // fault messages handled
+    size_t copies = 0;         // UFFDIO_COPY calls
+    size_t pages_copied = 0;
+    size_t reads = 0;          // read() calls on the userfaultfd
+    double copy_seconds = 0;   // time spent in UFFDIO_COPY
+    std::vector<float> fault_ns;  // touch latency of the pages that faulted
+    bool verified = true;
+};
+
+// Page contents served by the handler: a mapped file or a filled buffer
+class Source {
+public:
+    Source(const std::string& path, size_t size) : size_(size) {
+        if (path.empty()) {
+            void* p = nullptr;
+            if (posix_memalign(&p, 4096, size) != 0) {
+                error_ = "memory allocation failed";
+                return;
+            }
+            uint64_t* words = static_cast<uint64_t*>(p);
+            for (size_t i = 0; i < size / sizeof(uint64_t); ++i) {
+                words[i] = i * 0x9E3779B97F4A7C15ULL;
+            }
+            data_ = static_cast<char*>(p);
+            return;
+        }
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            error_ = path + ": " + std::strerror(errno);
+        } else if (static_cast<size_t>(st.st_size) < size) {
+            error_ = path + " is smaller than the region";
+        } else {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                error_ = std::string("mmap: ") + std::strerror(errno);
+            } else {
+                data_ = static_cast<char*>(p);
+                mapped_ = true;
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    ~Source() {
+        if (mapped_) {
+            munmap(data_, size_);
+        } else {
+            free(data_);
+        }
+    }
+    Source(const Source&) = delete;
+    Source& operator=(const Source&) = delete;
+
+    const char* data() const { return data_; }
+    const std::string& error() const { return error_; }
+
+private:
+    char* data_ = nullptr;
+    size_t size_;
+    bool mapped_ = false;
+    std::string error_;
+};
+
+int open_userfaultfd(bool& user_mode_only) {
+#ifdef SYS_userfaultfd
+    int flags = O_CLOEXEC | O_NONBLOCK;
+#ifdef UFFD_USER_MODE_ONLY
+    int fd = static_cast<int>(syscall(SYS_userfaultfd, flags | UFFD_USER_MODE_ONLY));
+    if (fd >= 0) {
+        user_mode_only = true;
+        return fd;
+    }
+#endif
+    // Kernels before 5.11 know no UFFD_USER_MODE_ONLY; this needs privileges
+    // or vm.unprivileged_userfaultfd=1
+    user_mode_only = false;
+    return static_cast<int>(syscall(SYS_userfaultfd, flags));
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Serves the faults of `region` until `stop_fd` is signalled. Every fault is
+// answered with one UFFDIO_COPY of the faulting page and up to prefetch - 1
+// following pages that are still missing.
+void serve_faults(int uffd, int stop_fd, char* region, size_t pages, size_t page,
+                  const char* source, int prefetch, std::vector<uint8_t>& faulted,
+                  FaultRun& run) {
+    std::vector<uint8_t> served(pages, 0);
+    uffd_msg msgs[64];
+    pollfd fds[2] = {{uffd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+    auto fail = [&](const char* what) {
+        run.ok = false;
+        run.failure = std::string(what) + ": " + std::strerror(errno);
+        // Let the kernel zero-fill the rest so the faulting threads finish
+        uffdio_range range = {reinterpret_cast<uintptr_t>(region), pages * page};
+        ioctl(uffd, UFFDIO_UNREGISTER, &range);
+        ioctl(uffd, UFFDIO_WAKE, &range);
+    };
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fail("poll");
+            return;
+        }
+        if (fds[1].revents & POLLIN) {
+            return;
+        }
+        ssize_t n = read(uffd, msgs, sizeof(msgs));
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            fail("read");
+            return;
+        }
+        ++run.reads;
+        for (size_t m = 0; m < n / sizeof(uffd_msg); ++m) {
+            if (msgs[m].event != UFFD_EVENT_PAGEFAULT) {
+                continue;
+            }
+            size_t index = (msgs[m].arg.pagefault.address - reinterpret_cast<uintptr_t>(region)) / page;
+            ++run.faults;
+            faulted[index] = 1;
+            if (served[index]) {
+                // Filled by an earlier prefetch while this fault was queued
+                uffdio_range range = {reinterpret_cast<uintptr_t>(region + index * page), page};
+                ioctl(uffd, UFFDIO_WAKE, &range);
+                continue;
+            }
+            size_t count = 1;
+            while (count < static_cast<size_t>(prefetch) && index + count < pages &&
+                   !served[index + count]) {
+                ++count;
+            }
+            double start = bench_now();
+            size_t done = 0;
+            int stalls = 0;
+            while (done < count * page) {
+                uffdio_copy copy;
+                copy.dst = reinterpret_cast<uintptr_t>(region + index * page + done);
+                copy.src = reinterpret_cast<uintptr_t>(source + index * page + done);
+                copy.len = count * page - done;
+                copy.mode = 0;
+                copy.copy = 0;
+                if (ioctl(uffd, UFFDIO_COPY, &copy) == 0) {
+                    break;
+                }
+                // The copy may stop part way; retry the rest, but give up
+                // when it keeps failing without progress
+                if (errno == EAGAIN && copy.copy > 0) {
+                    done += copy.copy;
+                    stalls = 0;
+                } else if (errno != EAGAIN || ++stalls > MAX_COPY_RETRIES) {
+                    fail("UFFDIO_COPY");
+                    return;
+                }
+            }
+            run.copy_seconds += bench_now() - start;
+            ++run.copies;
+            run.pages_copied += count;
+            std::fill(served.begin() + index, served.begin() + index + count, 1);
+        }
+    }
+}
+
+// Touches `pages` pages of `region` with `threads` threads, each reading the
+// first word of every page of its own contiguous slice. Records the latency
+// of every touch and returns the wall time; `sum` gets the words read.
+double touch_pages(char* region, size_t pages, size_t page, int threads,
+                   std::vector<float>& touch_ns, uint64_t& sum) {
+    std::atomic<bool> go{false};
+    std::vector<uint64_t> sums(threads, 0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            size_t first = pages * t / threads;
+            size_t last = pages * (t + 1) / threads;
+            uint64_t local = 0;
+            for (size_t i = first; i < last; ++i) {
+                double start = bench_now();
+                local += *reinterpret_cast<volatile uint64_t*>(region + i * page);
+                touch_ns[i] = static_cast<float>((bench_now() - start) * 1e9);
+            }
+            sums[t] = local;
+        });
+    }
+    double start = bench_now();
+    go.store(true, std::memory_order_release);
+    for (auto& w : workers) {
+        w.join();
+    }
+    double seconds = bench_now() - start;
+    sum = 0;
+    for (uint64_t s : sums) {
+        sum += s;
+    }
+    return seconds;
+}
+
+// First touch of a fresh anonymous region: every page is a kernel zero-fill fault
+FaultRun run_anonymous(size_t pages, size_t page, int threads) {
+    FaultRun run;
+    void* p = mmap(nullptr, pages * page, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        run.ok = false;
+        run.failure = std::string("mmap: ") + std::strerror(errno);
+        return run;
+    }
+    // Keep 4K pages so both pagers fault the same number of times
+    madvise(p, pages * page, MADV_NOHUGEPAGE);
+    std::vector<float> touch_ns(pages);
+    uint64_t sum = 0;
+    run.seconds = touch_pages(static_cast<char*>(p), pages, page, threads, touch_ns, sum);
+    run.faults = pages;
+    run.fault_ns = std::move(touch_ns);
+    munmap(p, pages * page);
+    return run;
+}
+
+FaultRun run_userfault(size_t pages, size_t page, int threads, int prefetch,
+                       const Source& source, uint64_t expected_sum) {
+    FaultRun run;
+    bool user_mode_only = false;
+    int uffd = open_userfaultfd(user_mode_only);
+    if (uffd < 0) {
+        run.ok = false;
+        run.failure = std::string("userfaultfd: ") + std::strerror(errno);
+        return run;
+    }
+    uffdio_api api = {UFFD_API, 0, 0};
+    if (ioctl(uffd, UFFDIO_API, &api) != 0) {
+        run.ok = false;
+        run.failure = std::string("UFFDIO_API: ") + std::strerror(errno);
+        close(uffd);
+        return run;
+    }
+    size_t size = pages * page;
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        run.ok = false;
+        run.failure = std::string("mmap: ") + std::strerror(errno);
+        close(uffd);
+        return run;
+    }
+    char* region = static_cast<char*>(p);
+    uffdio_register reg;
+    reg.range.start = reinterpret_cast<uintptr_t>(region);
+    reg.range.len = size;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+    reg.ioctls = 0;
+    if (ioctl(uffd, UFFDIO_REGISTER, &reg) != 0) {
+        run.ok = false;
+        run.failure = std::string("UFFDIO_REGISTER: ") + std::strerror(errno);
+        munmap(region, size);
+        close(uffd);
+        return run;
+    }
+    // Tells the handler thread to stop
+    int stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (stop_fd < 0) {
+        run.ok = false;
+        run.failure = std::string("eventfd: ") + std::strerror(errno);
+        munmap(region, size);
+        close(uffd);
+        return run;
+    }
+
+    std::vector<uint8_t> faulted(pages, 0);
+    std::thread handler(serve_faults, uffd, stop_fd, region, pages, page, source.data(),
+                        prefetch, std::ref(faulted), std::ref(run));
+    std::vector<float> touch_ns(pages);
+    uint64_t sum = 0;
+    double seconds = touch_pages(region, pages, page, threads, touch_ns, sum);
+    uint64_t one = 1;
+    if (write(stop_fd, &one, sizeof(one)) != sizeof(one)) {
+        perror("eventfd");
+    }
+    handler.join();
+    run.seconds = seconds;
+    run.verified = sum == expected_sum;
+    for (size_t i = 0; i < pages; ++i) {
+        if (faulted[i]) {
+            run.fault_ns.push_back(touch_ns[i]);
+        }
+    }
+
+    close(stop_fd);
+    munmap(region, size);
+    close(uffd);
+    return run;
+}
+
+struct Sweep {
+    std::vector<double> throughput, p50_us, p99_us;
+    FaultRun last;
+    FaultRun failed;
+};
+
+// Repeat `once` per the measure options, collecting MB/s and fault latency
+template <typename Fn>
+Sweep repeat(const MeasureOptions& measure_opts, size_t size, Fn once) {
+    Sweep sweep;
+    measure(measure_opts, [&](bool measured) {
+        FaultRun run = once();
+        if (!run.ok) {
+            sweep.failed = run;
+            return false;
+        }
+        if (measured) {
+            sweep.throughput.push_back(size / (1024.0 * 1024.0) / run.seconds);
+            std::sort(run.fault_ns.begin(), run.fault_ns.end());
+            sweep.p50_us.push_back(percentile(run.fault_ns, 50) / 1e3);
+            sweep.p99_us.push_back(percentile(run.fault_ns, 99) / 1e3);
+            sweep.last = std::move(run);
+        }
+        return true;
+    });
+    return sweep;
+}
+
+} // namespace
+
+void run_uffd_benchmark(const UffdOptions& opts, const MeasureOptions& measure_opts,
+                        BenchResults& results) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t pages = opts.region_size / page;
+    size_t size = pages * page;
+    if (pages == 0) {
+        std::cerr << "The region is smaller than a page\n";
+        return;
+    }
+    Source source(opts.source_path, size);
+    if (!source.error().empty()) {
+        std::cerr << source.error() << std::endl;
+        return;
+    }
+    // What the faulting threads must read if every page came from the source
+    uint64_t expected_sum = 0;
+    for (size_t i = 0; i < pages; ++i) {
+        expected_sum += *reinterpret_cast<const uint64_t*>(source.data() + i * page);
+    }
+
+    bool user_mode_only = false;
+    int probe = open_userfaultfd(user_mode_only);
+    if (probe < 0) {
+        std::cerr << "userfaultfd: " << std::strerror(errno) << std::endl;
+        return;
+    }
+    close(probe);
+    std::cout << "Region: " << (size >> 20) << " MB | Page: " << page << " B"
+              << " | Source: " << (opts.source_path.empty() ? "buffer" : opts.source_path)
+              << " | userfaultfd: " << (user_mode_only ? "UFFD_USER_MODE_ONLY" : "privileged")
+              << "\n";
+
+    std::vector<int> thread_counts;
+    for (int t = 1; t < opts.max_threads; t *= 2) {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(std::max(1, opts.max_threads));
+
+    bool reject = measure_opts.reject_outliers;
+    std::string source_name = opts.source_path.empty() ? "buffer" : "file";
+    for (int threads : thread_counts) {
+        Sweep anon = repeat(measure_opts, size, [&]() {
+            return run_anonymous(pages, page, threads);
+        });
+        std::cout << "Pager: kernel zero-fill | Threads: " << threads << " | ";
+        if (!anon.failed.ok) {
+            std::cout << "failed: " << anon.failed.failure << "\n";
+        } else {
+            Summary throughput = summarize(anon.throughput, reject);
+            std::cout << "Faults: " << anon.last.faults
+                      << " | Throughput: " << throughput << " MB/s"
+                      << " | Fault p50: " << summarize(anon.p50_us, reject).median << " us"
+                      << " | p99: " << summarize(anon.p99_us, reject).median << " us\n";
+            results.add("anonymous", "throughput", throughput, "MB/s").param("threads", threads);
+            results.add("anonymous", "fault_p99", summarize(anon.p99_us, reject), "us")
+                .param("threads", threads);
+        }
+
+        double base = 0;
+        for (int prefetch : opts.prefetch) {
+            prefetch = std::max(1, prefetch);
+            Sweep uffd = repeat(measure_opts, size, [&]() {
+                return run_userfault(pages, page, threads, prefetch, source, expected_sum);
+            });
+            std::cout << "Pager: userfaultfd | Threads: " << threads
+                      << " | Prefetch: " << prefetch << " | ";
+            if (!uffd.failed.ok) {
+                std::cout << "failed: " << uffd.failed.failure << "\n";
+                continue;
+            }
+            const FaultRun& last = uffd.last;
+            Summary throughput = summarize(uffd.throughput, reject);
+            Summary p50 = summarize(uffd.p50_us, reject);
+            Summary p99 = summarize(uffd.p99_us, reject);
+            if (base == 0) {
+                base = throughput.median;
+            }
+            std::cout << "Faults: " << last.faults
+                      << " | Pages/copy: " << static_cast<double>(last.pages_copied) / last.copies
+                      << " | Faults/read: " << static_cast<double>(last.faults) / last.reads
+                      << " | Throughput: " << throughput << " MB/s"
+                      << " (x" << throughput.median / base << ")"
+                      << " | Fault p50: " << p50.median << " us"
+                      << " | p99: " << p99.median << " us"
+                      << " | UFFDIO_COPY: " << last.copy_seconds / last.copies * 1e6 << " us";
+            if (!last.verified) {
+                std::cout << " | DATA MISMATCH";
+            }
+            std::cout << "\n";
+            auto add = [&](const std::string& metric, const Summary& s, const std::string& unit) {
+                results.add("userfaultfd", metric, s, unit)
+                    .param("threads", threads).param("prefetch", prefetch)
+                    .param("source", source_name);
+            };
+            add("throughput", throughput, "MB/s");
+            add("fault_p50", p50, "us");
+            add("fault_p99", p99, "us");
+        }
+    }
+}
+
+#else
+
+void run_uffd_benchmark(const UffdOptions&, const MeasureOptions&, BenchResults&) {
+    std::cerr << "userfaultfd is only available on Linux" << std::endl;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class BenchResults;
+struct MeasureOptions;
+
+struct UffdOptions {
+    size_t region_size = 1ULL << 30;     // lazily populated region
+    int max_threads = 1;                 // faulting threads: 1, 2, 4 .. max_threads
+    std::vector<int> prefetch = {1, 16}; // pages filled per fault (the faulting page and its neighbours)
+    std::string source_path;             // fill from this file; from a buffer when empty
+};
+
+// Demand paging served from user space: the region is registered with
+// userfaultfd (UFFD_USER_MODE_ONLY, so no privileges are needed) and a handler
+// thread fills every missing page with UFFDIO_COPY from the source while the
+// faulting threads touch the region page by page. Prints the throughput, the
+// fault latency seen by the faulting threads and the handler service time,
+// next to plain kernel zero-fill faults of an anonymous region. Linux only.
+void run_uffd_benchmark(const UffdOptions& opts, const MeasureOptions& measure_opts,
+                        BenchResults& results);
@@ -0,0 +1,176 @@
+#include "ram_stage.h"
+#include "bench_timer.h"
+
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+int data_sync(int fd) {
+#ifdef __linux__
+    return fdatasync(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+} // namespace
+
+RamStage::RamStage(char* region, int backing_fd, const RamStageConfig& config)
+    : region_(region), backing_fd_(backing_fd), config_(config) {
+    for (int i = 0; i < config_.flushers; ++i) {
+        flushers_.emplace_back(&RamStage::flusher_loop, this);
+    }
+}
+
+RamStage::~RamStage() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    data_cv_.notify_all();
+    for (auto& t : flushers_) {
+        t.join();
+    }
+}
+
+bool RamStage::write(const void* data, size_t len) {
+    std::lock_guard<std::mutex> writer_lock(writer_mutex_);
+    const char* src = static_cast<const char*>(data);
+    // Larger writes go in pieces so they never need more than half of the region
+    size_t max_piece = std::max<size_t>(1, config_.capacity / 2);
+
+    while (len > 0) {
+        size_t piece = std::min(len, max_piece);
+        uint64_t start;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (produced_ + piece - released_ > config_.capacity) {
+                double stall_start = bench_now();
+                space_cv_.wait(lock, [&] {
+                    return error_ || produced_ + piece - released_ <= config_.capacity;
+                });
+                stats_.stall_seconds += bench_now() - stall_start;
+            }
+            if (error_) {
+                return false;
+            }
+            start = produced_;
+        }
+        // [start, start + piece) is free and invisible to the flushers until
+        // produced_ moves, so it is filled without holding the lock.
+        size_t pos = start % config_.capacity;
+        size_t first = std::min(piece, config_.capacity - pos);
+        std::memcpy(region_ + pos, src, first);
+        std::memcpy(region_, src + first, piece - first);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (produced_ == released_) {
+                busy_since_ = bench_now();
+            }
+            produced_ += piece;
+            stats_.bytes_staged += piece;
+        }
+        data_cv_.notify_one();
+        src += piece;
+        len -= piece;
+    }
+    return true;
+}
+
+bool RamStage::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t target = produced_;
+    space_cv_.wait(lock, [&] { return error_ || released_ >= target; });
+    if (error_) {
+        return false;
+    }
+    lock.unlock();
+    return data_sync(backing_fd_) == 0;
+}
+
+RamStageStats RamStage::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    RamStageStats result = stats_;
+    if (produced_ != released_) {
+        result.busy_seconds += bench_now() - busy_since_;
+    }
+    return result;
+}
+
+void RamStage::flusher_loop() {
+    while (true) {
+        uint64_t begin, end;
+        bool more;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            data_cv_.wait(lock, [&] { return stop_ || claimed_ < produced_; });
+            if (claimed_ == produced_) {
+                return;  // stopping and nothing left
+            }
+            begin = claimed_;
+            end = std::min<uint64_t>(produced_, begin + config_.batch_bytes);
+            claimed_ = end;
+            more = claimed_ < produced_;
+        }
+        if (more) {
+            data_cv_.notify_one();  // work for another flusher
+        }
+
+        size_t len = end - begin;
+        size_t pos = begin % config_.capacity;
+        size_t first = std::min(len, config_.capacity - pos);
+        iovec iov[2] = {{region_ + pos, first}, {region_, len - first}};
+        int iov_count = first == len ? 1 : 2;
+
+        bool ok = true;
+        for (size_t done = 0; done < len;) {
+            ssize_t n = pwritev(backing_fd_, iov, iov_count, static_cast<off_t>(begin + done));
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            done += n;
+            // Skip what was written in the iovecs
+            for (int i = 0; i < iov_count && n > 0; ++i) {
+                size_t step = std::min<size_t>(iov[i].iov_len, n);
+                iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + step;
+                iov[i].iov_len -= step;
+                n -= step;
+            }
+        }
+        if (!ok) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = true;
+        }
+        release(begin, end, ok);
+    }
+}
+
+// Batches complete out of order; space is freed only up to the first gap.
+// A failed batch frees its space too, so writers and flush() do not hang;
+// error_ makes them fail instead.
+void RamStage::release(uint64_t begin, uint64_t end, bool written) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_[begin] = end;
+        if (written) {
+            stats_.bytes_flushed += end - begin;
+        } else {
+            stats_.bytes_failed += end - begin;
+        }
+        ++stats_.batches;
+        auto it = done_.begin();
+        while (it != done_.end() && it->first == released_) {
+            released_ = it->second;
+            it = done_.erase(it);
+        }
+        if (released_ == produced_) {
+            stats_.busy_seconds += bench_now() - busy_since_;
+        }
+    }
+    space_cv_.notify_all();
+}
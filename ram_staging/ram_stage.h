@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct RamStageConfig {
+    size_t capacity = 256 * 1024 * 1024;  // size of the RAM region
+    int flushers = 2;                     // background threads writing to the backing file
+    size_t batch_bytes = 1024 * 1024;     // maximum size of one write to the backing file
+};
+
+struct RamStageStats {
+    uint64_t bytes_staged = 0;    // acknowledged by write()
+    uint64_t bytes_flushed = 0;   // written to the backing file
+    uint64_t bytes_failed = 0;    // taken by a flusher whose write failed
+    uint64_t batches = 0;         // writes to the backing file
+    double stall_seconds = 0;     // time write() waited for free space
+    double busy_seconds = 0;      // time there was data waiting to be flushed
+};
+
+// Write-back staging tier: write() copies the data into a bounded RAM
+// region and returns at once, a pool of flusher threads appends it to the
+// backing file in batches. When the region is full write() blocks until
+// the flushers free some space (backpressure).
+//
+// The region is used as a ring: byte N of the stream lives at
+// region[N % capacity] and is written to the backing file at offset N,
+// so a batch is at most two pieces of the region and one pwritev().
+class RamStage {
+public:
+    // `region` must stay mapped and `backing_fd` open for the lifetime of the stage
+    RamStage(char* region, int backing_fd, const RamStageConfig& config);
+    // Drains the region and stops the flushers
+    ~RamStage();
+
+    RamStage(const RamStage&) = delete;
+    RamStage& operator=(const RamStage&) = delete;
+
+    // Append `len` bytes to the stream. Returns false if a flusher failed.
+    bool write(const void* data, size_t len);
+
+    // Flush barrier: wait until everything written before the call is in
+    // the backing file and fdatasync'ed. Returns false on I/O errors,
+    // including failed writes of a flusher (counted in bytes_failed).
+    bool flush();
+
+    RamStageStats stats() const;
+
+private:
+    void flusher_loop();
+    void release(uint64_t begin, uint64_t end, bool written);
+
+    char* region_;
+    int backing_fd_;
+    RamStageConfig config_;
+
+    std::mutex writer_mutex_;        // serializes write() calls
+    mutable std::mutex mutex_;       // protects everything below
+    std::condition_variable data_cv_;    // flushers: new data or stop
+    std::condition_variable space_cv_;   // writers and flush(): data released
+    uint64_t produced_ = 0;   // end of the acknowledged data
+    uint64_t claimed_ = 0;    // end of the data taken by flushers
+    uint64_t released_ = 0;   // end of the data written to the backing file
+    std::map<uint64_t, uint64_t> done_;  // written ranges beyond released_
+    bool stop_ = false;
+    bool error_ = false;
+    RamStageStats stats_;
+    double busy_since_ = 0;
+
+    std::vector<std::thread> flushers_;
+};
@@ -0,0 +1,306 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ram_stage.h"
+#include "ramdisk_device.h"
+#include "bench_results.h"
+
+using namespace std::chrono;
+
+struct Options {
+    std::string path = "/tmp/ram_staging_test.dat";  // backing file
+    RamdiskConfig ramdisk_config;
+    RamStageConfig stage;
+    size_t record_size = 64 * 1024;
+    size_t burst_mb = 512;
+    int bursts = 4;
+    int gap_ms = 500;     // idle time between bursts
+    bool dsync = true;    // open the backing file with O_DSYNC
+    bool verbose = false;
+    ResultsOptions results;
+    bool help = false;
+};
+
+void print_help(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [-p=path] [-b=hdiutil|shm|memfd] [-c=N] [-j=N]\n"
+              << "       [-a=N] [-r=N] [-u=N] [-n=N] [-g=N] [-s=0|1] [-v]\n"
+              << "       [--json=FILE] [--csv=FILE] [--compare=FILE] [--threshold=N] [-h]\n"
+              << "  -p=path  Backing file (default: /tmp/ram_staging_test.dat)\n"
+              << "  -b=...   RAM disk backend holding the staging region (see ramdisk)\n"
+              << "  -c=N     Staging region size in MB (default: 256)\n"
+              << "  -j=N     Number of flusher threads (default: 2)\n"
+              << "  -a=N     Maximum batch written by a flusher in KB (default: 1024)\n"
+              << "  -r=N     Record size in KB (default: 64)\n"
+              << "  -u=N     Burst size in MB (default: 512)\n"
+              << "  -n=N     Number of bursts (default: 4)\n"
+              << "  -g=N     Idle time between bursts in ms (default: 500)\n"
+              << "  -s=0     Buffered backing file\n"
+              << "  -s=1     Backing file opened with O_DSYNC (default)\n"
+              << "  -v       Verbose output\n"
+              << "  -h       Show this help message\n";
+    print_results_help();
+}
+
+Options parse_args(int argc, char* argv[]) {
+    Options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "-h") {
+            opts.help = true;
+        } else if (arg == "-v") {
+            opts.verbose = true;
+        } else if (arg.rfind("-p=", 0) == 0) {
+            opts.path = arg.substr(3);
+        } else if (arg.rfind("-b=", 0) == 0) {
+            if (!parse_ramdisk_backend(arg.substr(3), opts.ramdisk_config.backend)) {
+                std::cerr << "Invalid value for -b: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-c=", 0) == 0) {
+            opts.stage.capacity = std::stoul(arg.substr(3)) * 1024 * 1024;
+        } else if (arg.rfind("-j=", 0) == 0) {
+            opts.stage.flushers = std::stoi(arg.substr(3));
+        } else if (arg.rfind("-a=", 0) == 0) {
+            opts.stage.batch_bytes = std::stoul(arg.substr(3)) * 1024;
+        } else if (arg.rfind("-r=", 0) == 0) {
+            opts.record_size = std::stoul(arg.substr(3)) * 1024;
+        } else if (arg.rfind("-u=", 0) == 0) {
+            opts.burst_mb = std::stoul(arg.substr(3));
+        } else if (arg.rfind("-n=", 0) == 0) {
+            opts.bursts = std::stoi(arg.substr(3));
+        } else if (arg.rfind("-g=", 0) == 0) {
+            opts.gap_ms = std::stoi(arg.substr(3));
+        } else if (arg.rfind("-s=", 0) == 0) {
+            opts.dsync = std::stoi(arg.substr(3)) != 0;
+        } else if (parse_results_arg(arg, opts.results)) {
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            opts.help = true;
+        }
+    }
+    if (opts.stage.capacity == 0 || opts.stage.flushers < 1 || opts.stage.batch_bytes == 0 ||
+        opts.record_size == 0) {
+        std::cerr << "Sizes and the number of flushers must be positive\n";
+        opts.help = true;
+    }
+
+    return opts;
+}
+
+int open_backing_file(const Options& opts) {
+    int flags = O_CREAT | O_WRONLY | O_TRUNC;
+    if (opts.dsync) {
+        flags |= O_DSYNC;
+    }
+    int fd = open(opts.path.c_str(), flags, 0644);
+    if (fd < 0) {
+        perror("open backing file");
+    }
+    return fd;
+}
+
+// Map the staging region from the RAM disk: the memfd itself, or a file on
+// the RAM disk directory sized to the region.
+char* map_region(const Ramdisk& disk, size_t capacity, int& fd) {
+    std::string path = ramdisk_file_path(disk, "stage.buf");
+    fd = open(path.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("open staging region");
+        return nullptr;
+    }
+    if (ramdisk_is_directory(disk) && ftruncate(fd, capacity) != 0) {
+        perror("ftruncate staging region");
+        return nullptr;
+    }
+    void* p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap staging region");
+        return nullptr;
+    }
+    // Fault the region in now, not during the first burst
+    std::memset(p, 0, capacity);
+    return static_cast<char*>(p);
+}
+
+// Prints the burst and returns its absorb rate in MB/s
+double print_burst(int burst, size_t bytes, double seconds, double stall_seconds) {
+    double speed = (bytes / (1024.0 * 1024.0)) / seconds;
+    std::cout << "Burst " << burst << ": " << speed
+              << " MB/s | Time: " << seconds * 1000 << " ms | Stalled: "
+              << stall_seconds * 1000 << " ms\n";
+    return speed;
+}
+
+// Absorb rate of every burst and the final flush barrier of one run
+void add_results(BenchResults& results, const Options& opts, const std::string& name,
+                 const std::vector<double>& burst_speeds, double barrier_ms) {
+    double sum = 0;
+    for (double s : burst_speeds) {
+        sum += s;
+    }
+    results.add(name, "burst", burst_speeds.empty() ? 0 : sum / burst_speeds.size(), "MB/s")
+        .with_samples(burst_speeds)
+        .param("burst_mb", opts.burst_mb).param("record_size", opts.record_size)
+        .param("dsync", opts.dsync);
+    results.add(name, "flush_barrier", barrier_ms, "ms")
+        .param("burst_mb", opts.burst_mb).param("record_size", opts.record_size)
+        .param("dsync", opts.dsync);
+}
+
+// Bursts acknowledged by the RAM stage and drained by the flushers
+bool run_staged(const Options& opts, char* region, const std::vector<char>& record,
+                BenchResults& results) {
+    int fd = open_backing_file(opts);
+    if (fd < 0) {
+        return false;
+    }
+    size_t burst_bytes = opts.burst_mb * 1024 * 1024;
+    bool ok = true;
+    {
+        RamStage stage(region, fd, opts.stage);
+        std::cout << "=== Staged: " << opts.stage.capacity / (1024 * 1024) << " MB region, "
+                  << opts.stage.flushers << " flusher(s), "
+                  << opts.stage.batch_bytes / 1024 << " KB batches ===\n";
+        std::vector<double> burst_speeds;
+        double start = bench_now();
+        for (int b = 0; b < opts.bursts && ok; ++b) {
+            double stalled_before = stage.stats().stall_seconds;
+            double burst_start = bench_now();
+            size_t written = 0;
+            while (written < burst_bytes && ok) {
+                ok = stage.write(record.data(), record.size());
+                if (ok) {
+                    written += record.size();
+                }
+            }
+            double seconds = bench_now() - burst_start;
+            burst_speeds.push_back(
+                print_burst(b, written, seconds, stage.stats().stall_seconds - stalled_before));
+            std::this_thread::sleep_for(milliseconds(opts.gap_ms));
+        }
+        double barrier_start = bench_now();
+        ok = stage.flush() && ok;
+        double end = bench_now();
+
+        RamStageStats stats = stage.stats();
+        std::cout << "Flush barrier: " << (end - barrier_start) * 1000 << " ms | Drain: ";
+        // The flushers may not have run at all, e.g. when the first write failed
+        double drain = stats.busy_seconds > 0
+            ? (stats.bytes_flushed / (1024.0 * 1024.0)) / stats.busy_seconds : 0;
+        if (drain > 0) {
+            std::cout << drain << " MB/s";
+        } else {
+            std::cout << "n/a";
+        }
+        std::cout << " | Batches: " << stats.batches
+                  << " | Total: " << (end - start) << " s";
+        if (stats.bytes_failed > 0) {
+            std::cout << " | Failed: " << stats.bytes_failed << " bytes";
+        }
+        std::cout << "\n";
+        add_results(results, opts, "staged", burst_speeds,
+                    (end - barrier_start) * 1000);
+        if (drain > 0) {
+            results.add("staged", "drain", drain, "MB/s")
+                .param("flushers", opts.stage.flushers).param("batch_bytes", opts.stage.batch_bytes)
+                .param("dsync", opts.dsync);
+        }
+    }
+    close(fd);
+    if (!ok) {
+        std::cerr << "Staged write failed\n";
+    }
+    return ok;
+}
+
+// The same bursts written straight to the backing file
+bool run_direct(const Options& opts, const std::vector<char>& record, BenchResults& results) {
+    int fd = open_backing_file(opts);
+    if (fd < 0) {
+        return false;
+    }
+    size_t burst_bytes = opts.burst_mb * 1024 * 1024;
+    std::cout << "=== Direct ===\n";
+    std::vector<double> burst_speeds;
+    double start = bench_now();
+    for (int b = 0; b < opts.bursts; ++b) {
+        double burst_start = bench_now();
+        size_t written = 0;
+        while (written < burst_bytes) {
+            if (write(fd, record.data(), record.size()) != static_cast<ssize_t>(record.size())) {
+                perror("write");
+                close(fd);
+                return false;
+            }
+            written += record.size();
+        }
+        double seconds = bench_now() - burst_start;
+        burst_speeds.push_back(print_burst(b, written, seconds, 0));
+        std::this_thread::sleep_for(milliseconds(opts.gap_ms));
+    }
+    double barrier_start = bench_now();
+    if (fsync(fd) != 0) {
+        perror("fsync");
+        close(fd);
+        return false;
+    }
+    double end = bench_now();
+    std::cout << "Flush barrier: " << (end - barrier_start) * 1000
+              << " ms | Total: " << (end - start) << " s\n";
+    add_results(results, opts, "direct", burst_speeds,
+                (end - barrier_start) * 1000);
+    close(fd);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parse_args(argc, argv);
+
+    if (options.help) {
+        print_help(argv[0]);
+        return 0;
+    }
+
+    RamdiskConfig config = options.ramdisk_config;
+    config.size_mb = static_cast<int>(options.stage.capacity / (1024 * 1024)) + 1;
+    Ramdisk disk;
+    int err = create_ramdisk(config, disk, options.verbose);
+    if (err != 0) {
+        std::cerr << "Failed to create RAM disk (error " << err << ")" << std::endl;
+        return 1;
+    }
+
+    BenchResults results("ram_staging");
+    results.set_path(options.path);
+
+    int region_fd = -1;
+    char* region = map_region(disk, options.stage.capacity, region_fd);
+    bool ok = region != nullptr;
+    if (ok) {
+        std::vector<char> record(options.record_size, 'S');
+        ok = run_staged(options, region, record, results) && run_direct(options, record, results);
+        munmap(region, options.stage.capacity);
+    }
+    if (region_fd >= 0) {
+        close(region_fd);
+    }
+    unlink(options.path.c_str());
+
+    if (unmount_ramdisk(disk, options.verbose) != 0) {
+        std::cerr << "Error ejecting RAM disk" << std::endl;
+        return 1;
+    }
+    if (!ok) {
+        return 1;
+    }
+    return finish_results(results, options.results);
+}
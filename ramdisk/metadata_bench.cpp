@@ -0,0 +1,251 @@
+#include "metadata_bench.h"
+#include "bench_results.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ftw.h>
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct PhaseCount {
+    size_t ops = 0;
+    size_t errors = 0;
+    double timed = 0;  // seconds in the measured calls, for phases that time them themselves
+};
+
+// Rates of every phase over the measured runs
+struct PhaseLog {
+    std::vector<std::string> order;
+    std::map<std::string, std::vector<double>> rates;    // ops/s
+    std::map<std::string, std::vector<double>> seconds;
+
+    void add(const std::string& name, double rate, double elapsed) {
+        if (!rates.count(name)) {
+            order.push_back(name);
+        }
+        rates[name].push_back(rate);
+        seconds[name].push_back(elapsed);
+    }
+};
+
+class TestTree {
+public:
+    TestTree(const MetadataOptions& opts)
+        : root_(opts.base_path + "/metabench"), fanout_(opts.fanout) {}
+
+    const std::string& root() const { return root_; }
+
+    std::string thread_dir(int t) const {
+        return root_ + "/t" + std::to_string(t);
+    }
+
+    // Directories of one thread, parents first
+    std::vector<std::string> dirs(int t) const {
+        std::vector<std::string> result = {thread_dir(t)};
+        for (int a = 0; a < fanout_; ++a) {
+            std::string level1 = thread_dir(t) + "/d" + std::to_string(a);
+            result.push_back(level1);
+            for (int b = 0; b < fanout_; ++b) {
+                result.push_back(level1 + "/d" + std::to_string(b));
+            }
+        }
+        return result;
+    }
+
+    // Files are spread round-robin over the leaf directories
+    std::string file(int t, int i, const char* suffix = "") const {
+        int leaf = i % (fanout_ * fanout_);
+        return thread_dir(t) + "/d" + std::to_string(leaf / fanout_) +
+               "/d" + std::to_string(leaf % fanout_) + "/f" + std::to_string(i) + suffix;
+    }
+
+private:
+    std::string root_;
+    int fanout_;
+};
+
+// Run `fn` on every thread and log the rate of the operation. When the phase
+// times its calls itself, the slowest thread's total of them is the phase time.
+// Returns false, and logs nothing, if any operation failed.
+bool run_phase(const char* name, const MetadataOptions& opts, PhaseLog& log,
+               const std::function<void(int, PhaseCount&)>& fn) {
+    int threads = opts.threads;
+    std::vector<PhaseCount> counts(threads);
+    std::vector<std::thread> workers;
+    double start = bench_now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back(fn, t, std::ref(counts[t]));
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    double elapsed = bench_now() - start;
+
+    PhaseCount total;
+    double timed = 0;
+    for (const PhaseCount& c : counts) {
+        total.ops += c.ops;
+        total.errors += c.errors;
+        timed = std::max(timed, c.timed);
+    }
+    if (timed > 0) {
+        elapsed = timed;
+    }
+    if (total.errors != 0) {
+        std::cerr << "Op: " << name << " | Errors: " << total.errors << std::endl;
+        return false;
+    }
+    log.add(name, total.ops / elapsed, elapsed);
+    return true;
+}
+
+// Remove whatever part of the test tree exists, ignoring the errors
+void remove_tree(const TestTree& tree) {
+    auto remove_entry = [](const char* path, const struct stat*, int, struct FTW*) {
+        remove(path);
+        return 0;
+    };
+    nftw(tree.root().c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// Build, exercise and remove the test tree once; phases are logged when `log`
+// is set and every phase succeeded
+bool run_once(const MetadataOptions& opts, PhaseLog* log, bool verbose) {
+    TestTree tree(opts);
+    int files = opts.files_per_thread;
+    std::vector<char> data(opts.file_size, 'M');
+    PhaseLog run;
+
+    if (mkdir(tree.root().c_str(), 0755) != 0) {
+        perror(("mkdir " + tree.root()).c_str());
+        return false;
+    }
+
+    bool ok = run_phase("mkdir", opts, run, [&](int t, PhaseCount& c) {
+        for (const std::string& dir : tree.dirs(t)) {
+            ++c.ops;
+            if (mkdir(dir.c_str(), 0755) != 0) ++c.errors;
+        }
+    });
+    ok = ok && run_phase("create", opts, run, [&](int t, PhaseCount& c) {
+        for (int i = 0; i < files; ++i, ++c.ops) {
+            int fd = open(tree.file(t, i).c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+            if (fd < 0) {
+                ++c.errors;
+                continue;
+            }
+            close(fd);
+        }
+    });
+    ok = ok && run_phase("write", opts, run, [&](int t, PhaseCount& c) {
+        for (int i = 0; i < files; ++i, ++c.ops) {
+            int fd = open(tree.file(t, i).c_str(), O_WRONLY);
+            if (fd < 0) {
+                ++c.errors;
+                continue;
+            }
+            if (write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) ++c.errors;
+            close(fd);
+        }
+    });
+    // Only the fsync() calls are timed, not the open and close around them
+    ok = ok && run_phase("fsync", opts, run, [&](int t, PhaseCount& c) {
+        for (int i = 0; i < files; ++i, ++c.ops) {
+            int fd = open(tree.file(t, i).c_str(), O_WRONLY);
+            if (fd < 0) {
+                ++c.errors;
+                continue;
+            }
+            double start = bench_now();
+            if (fsync(fd) != 0) ++c.errors;
+            c.timed += bench_now() - start;
+            close(fd);
+        }
+    });
+    ok = ok && run_phase("stat", opts, run, [&](int t, PhaseCount& c) {
+        struct stat st;
+        for (int i = 0; i < files; ++i, ++c.ops) {
+            if (stat(tree.file(t, i).c_str(), &st) != 0) ++c.errors;
+        }
+    });
+    ok = ok && run_phase("open-read", opts, run, [&](int t, PhaseCount& c) {
+        std::vector<char> buffer(opts.file_size);
+        for (int i = 0; i < files; ++i, ++c.ops) {
+            int fd = open(tree.file(t, i).c_str(), O_RDONLY);
+            if (fd < 0) {
+                ++c.errors;
+                continue;
+            }
+            if (read(fd, buffer.data(), buffer.size()) != static_cast<ssize_t>(buffer.size())) ++c.errors;
+            close(fd);
+        }
+    });
+    ok = ok && run_phase("rename", opts, run, [&](int t, PhaseCount& c) {
+        for (int i = 0; i < files; ++i, ++c.ops) {
+            if (rename(tree.file(t, i).c_str(), tree.file(t, i, ".r").c_str()) != 0) ++c.errors;
+        }
+    });
+    ok = ok && run_phase("unlink", opts, run, [&](int t, PhaseCount& c) {
+        for (int i = 0; i < files; ++i, ++c.ops) {
+            if (unlink(tree.file(t, i, ".r").c_str()) != 0) ++c.errors;
+        }
+    });
+    ok = ok && run_phase("rmdir", opts, run, [&](int t, PhaseCount& c) {
+        std::vector<std::string> dirs = tree.dirs(t);
+        for (auto it = dirs.rbegin(); it != dirs.rend(); ++it, ++c.ops) {
+            if (rmdir(it->c_str()) != 0) ++c.errors;
+        }
+    });
+
+    if (!ok) {
+        // Leave nothing behind, or every later run fails with EEXIST
+        remove_tree(tree);
+        return false;
+    }
+    if (rmdir(tree.root().c_str()) != 0) {
+        perror(("rmdir " + tree.root()).c_str());
+        return false;
+    }
+    if (verbose) {
+        std::cout << "The test tree removed." << std::endl;
+    }
+    if (log) {
+        for (const std::string& name : run.order) {
+            log->add(name, run.rates[name][0], run.seconds[name][0]);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool run_metadata_benchmark(const MetadataOptions& opts, const MeasureOptions& measure_opts,
+                            BenchResults& results, bool verbose) {
+    std::cout << "Metadata test in " << opts.base_path << "/metabench: " << opts.threads
+              << " thread(s), " << opts.files_per_thread << " files of " << opts.file_size
+              << " bytes per thread, fan-out " << opts.fanout << std::endl;
+
+    PhaseLog log;
+    bool ok = measure(measure_opts, [&](bool measured) {
+        return run_once(opts, measured ? &log : nullptr, verbose);
+    });
+
+    for (const std::string& name : log.order) {
+        Summary rate = summarize(log.rates[name], measure_opts.reject_outliers);
+        std::cout << "Op: " << name << " | Ops/s: " << rate
+                  << " | Time: " << summarize(log.seconds[name], measure_opts.reject_outliers).median
+                  << " s" << std::endl;
+        results.add(name, "ops", rate, "ops/s").param("threads", opts.threads)
+            .param("file_size", opts.file_size).param("fanout", opts.fanout);
+    }
+    return ok;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class BenchResults;
+struct MeasureOptions;
+
+struct MetadataOptions {
+    std::string base_path = ".";  // directory where the test tree is created
+    int threads = 4;              // every thread works on its own subtree
+    int files_per_thread = 10000;
+    size_t file_size = 4096;      // bytes written to and read from every file
+    int fanout = 16;              // subdirectories per level, two levels per thread
+};
+
+// Create/write/fsync/stat/open-read/rename/unlink many small files in a
+// directory tree and print ops/s for every operation type.
+// Returns false if the test tree could not be created or removed, or any
+// operation failed.
+bool run_metadata_benchmark(const MetadataOptions& opts, const MeasureOptions& measure_opts,
+                            BenchResults& results, bool verbose);
@@ -0,0 +1,220 @@
+#include "overhead_bench.h"
+#include "bench_results.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+enum class Workload { SeqWrite, SeqRead, RandWrite, RandRead };
+
+struct WorkloadInfo {
+    Workload workload;
+    const char* name;
+};
+
+const WorkloadInfo WORKLOADS[] = {
+    {Workload::SeqWrite, "seq write"},
+    {Workload::SeqRead, "seq read"},
+    {Workload::RandWrite, "rand write"},
+    {Workload::RandRead, "rand read"},
+};
+
+// A place the workloads write to and read from
+class Target {
+public:
+    virtual ~Target() = default;
+    virtual const char* name() const = 0;
+    virtual bool write(const char* buf, size_t len, size_t offset) = 0;
+    virtual bool read(char* buf, size_t len, size_t offset) = 0;
+    // End of a write workload, included in its time
+    virtual bool sync() { return true; }
+    // Start of a read workload
+    virtual void drop_cache() {}
+};
+
+class MemoryTarget : public Target {
+public:
+    explicit MemoryTarget(size_t size) : size_(size) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            data_ = static_cast<char*>(p);
+            // Fault the pages in, the file targets are measured without allocation too
+            std::memset(data_, 0, size);
+        }
+    }
+    ~MemoryTarget() override {
+        if (data_) munmap(data_, size_);
+    }
+    bool ok() const { return data_ != nullptr; }
+    const char* name() const override { return "memory"; }
+    bool write(const char* buf, size_t len, size_t offset) override {
+        std::memcpy(data_ + offset, buf, len);
+        return true;
+    }
+    bool read(char* buf, size_t len, size_t offset) override {
+        std::memcpy(buf, data_ + offset, len);
+        return true;
+    }
+
+private:
+    char* data_ = nullptr;
+    size_t size_;
+};
+
+class FileTarget : public Target {
+public:
+    FileTarget(const char* name, const std::string& path) : name_(name) {
+        fd_ = open(path.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd_ < 0) {
+            perror(("open " + path).c_str());
+        }
+    }
+    ~FileTarget() override {
+        if (fd_ >= 0) close(fd_);
+    }
+    bool ok() const { return fd_ >= 0; }
+    const char* name() const override { return name_; }
+    bool write(const char* buf, size_t len, size_t offset) override {
+        return pwrite(fd_, buf, len, offset) == static_cast<ssize_t>(len);
+    }
+    bool read(char* buf, size_t len, size_t offset) override {
+        return pread(fd_, buf, len, offset) == static_cast<ssize_t>(len);
+    }
+    // Written data must reach the storage, otherwise the disk is measured as page cache
+    bool sync() override { return fsync(fd_) == 0; }
+    // For a RAM disk the cache is the storage and nothing is dropped
+    void drop_cache() override {
+#ifdef F_NOCACHE
+        fcntl(fd_, F_NOCACHE, 1);
+#elif defined(POSIX_FADV_DONTNEED)
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    }
+
+private:
+    const char* name_;
+    int fd_ = -1;
+};
+
+// Returns MB/s, or a negative value on an I/O error
+double run_workload(Target& target, Workload workload, const OverheadOptions& opts,
+                    std::vector<char>& buffer) {
+    size_t size = opts.size_mb * 1024 * 1024;
+    bool random = workload == Workload::RandWrite || workload == Workload::RandRead;
+    bool is_write = workload == Workload::SeqWrite || workload == Workload::RandWrite;
+    size_t block = random ? opts.random_block : opts.seq_block;
+    size_t ops = size / block;
+    // The same offsets for every target
+    std::mt19937_64 rng(42);
+
+    if (!is_write) {
+        target.drop_cache();
+    }
+    volatile char sink = 0;
+    double start = bench_now();
+    for (size_t i = 0; i < ops; ++i) {
+        size_t offset = (random ? rng() % ops : i) * block;
+        bool ok = is_write ? target.write(buffer.data(), block, offset)
+                           : target.read(buffer.data(), block, offset);
+        if (!ok) {
+            return -1;
+        }
+        sink = sink + buffer[0];
+    }
+    if (is_write && !target.sync()) {
+        return -1;
+    }
+    double elapsed = bench_now() - start;
+    return (ops * block / (1024.0 * 1024.0)) / elapsed;
+}
+
+} // namespace
+
+bool run_overhead_benchmark(const OverheadOptions& opts, const MeasureOptions& measure_opts,
+                            BenchResults& results, bool verbose) {
+    size_t size = opts.size_mb * 1024 * 1024;
+    if (opts.seq_block == 0 || opts.random_block == 0 ||
+        size < opts.seq_block || size < opts.random_block) {
+        std::cerr << "Block sizes must be positive and fit in " << opts.size_mb << " MB" << std::endl;
+        return false;
+    }
+
+    MemoryTarget memory(size);
+    if (!memory.ok()) {
+        std::cerr << "Memory allocation failed." << std::endl;
+        return false;
+    }
+    std::vector<Target*> targets = {&memory};
+    std::vector<std::unique_ptr<FileTarget>> files;
+    if (!opts.ram_file.empty()) {
+        files.emplace_back(new FileTarget("ram fs", opts.ram_file));
+    }
+    if (!opts.disk_file.empty()) {
+        files.emplace_back(new FileTarget("disk", opts.disk_file));
+    }
+    for (auto& file : files) {
+        if (!file->ok()) {
+            return false;
+        }
+        targets.push_back(file.get());
+    }
+
+    std::cout << "Workload size: " << opts.size_mb << " MB | sequential block: "
+              << opts.seq_block << " B | random block: " << opts.random_block << " B" << std::endl;
+
+    std::vector<char> buffer(std::max(opts.seq_block, opts.random_block), 'R');
+    bool ok = true;
+    for (const WorkloadInfo& w : WORKLOADS) {
+        double raw = 0;
+        std::cout << "Workload: " << w.name;
+        for (Target* target : targets) {
+            std::vector<double> speeds;
+            bool target_ok = measure(measure_opts, [&](bool measured) {
+                double speed = run_workload(*target, w.workload, opts, buffer);
+                if (speed >= 0 && measured) {
+                    speeds.push_back(speed);
+                }
+                return speed >= 0;
+            });
+            std::cout << " | " << target->name() << ": ";
+            if (!target_ok) {
+                std::cout << "I/O error";
+                ok = false;
+                continue;
+            }
+            Summary summary = summarize(speeds, measure_opts.reject_outliers);
+            double speed = summary.median;
+            std::cout << summary << " MB/s";
+            results.add(w.name, "throughput", summary, "MB/s").param("target", target->name())
+                .param("size_mb", opts.size_mb).param("random_block", opts.random_block);
+            if (target == &memory) {
+                raw = speed;
+            } else if (raw > 0) {
+                // Share of the raw memory bandwidth lost to the filesystem and the syscalls
+                std::cout << " (overhead " << 1.0 - speed / raw << ")";
+            } else {
+                std::cout << " (overhead n/a, no memory baseline)";
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    files.clear();
+    if (!opts.disk_file.empty()) {
+        remove(opts.disk_file.c_str());
+    }
+    if (verbose) {
+        std::cout << "The test files closed." << std::endl;
+    }
+    return ok;
+}
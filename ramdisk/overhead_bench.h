@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class BenchResults;
+struct MeasureOptions;
+
+struct OverheadOptions {
+    std::string ram_file;      // file on the RAM disk; skipped when empty
+    std::string disk_file;     // file in the disk directory; skipped when empty
+    size_t size_mb = 256;      // data written and read by every workload
+    size_t seq_block = 1024 * 1024;
+    size_t random_block = 4096;
+};
+
+// Run sequential and random write/read workloads against an anonymous
+// memory buffer, a file on the RAM disk and a file on the disk, and print
+// the throughput of every target together with the filesystem and syscall
+// overhead as a fraction of the raw memory bandwidth.
+bool run_overhead_benchmark(const OverheadOptions& opts, const MeasureOptions& measure_opts,
+                            BenchResults& results, bool verbose);
@@ -5,65 +5,25 @@
 #include <string>
 #include <unistd.h>
 
-// RAM disk size in megabytes
-constexpr int RAMDISK_SIZE_MB = 2047;
-const std::string VOLUME_NAME = "RAMDisk";
-const std::string MOUNT_PATH = "/Volumes/" + VOLUME_NAME;
-
-// Get the device ID for the RAM disk (e.g., /dev/disk3)
-std::string create_ramdisk_device(int size_mb, bool verbose) {
-    int blocks = size_mb * 1024 * 1024 / 512;
-    std::string cmd = "hdiutil attach -nomount ram://" + std::to_string(blocks);
-
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) return "";
-
-    char buffer[128];
-    std::string result;
-    while (fgets(buffer, sizeof(buffer), pipe)) {
-        result += buffer;
-    }
-
-    pclose(pipe);
-    // Remove trailing spaces and newlines
-    result.erase(result.find_last_not_of(" \n\r\t") + 1);
-    if (verbose) {
-        std::cout << "Created RAM disk device: " << result << std::endl;
-    }
-    // Ensure the result is a valid device path
-    if (result.empty() || result.find("/dev/disk") == std::string::npos) {
-        return "";
-    }
-
-    return result;
-}
-
-// Format and mount the RAM disk as a volume
-bool mount_ramdisk(const std::string& device, const std::string& volume_name) {
-    std::string cmd = "diskutil erasevolume HFS+ " + volume_name + " " + device +
-                      " >/dev/null 2>&1";
-    return system(cmd.c_str()) == 0;
-}
-
-// Unmount and eject the RAM disk
-bool eject_ramdisk(const std::string& mount_path) {
-    std::string cmd = "diskutil eject \"" + mount_path + "\" >/dev/null 2>&1";
-    return system(cmd.c_str()) == 0;
-}
-
-// Check if the RAM disk exists in /Volumes
-bool is_ramdisk_mounted(const std::string& mount_path) {
-    return access(mount_path.c_str(), F_OK) == 0;
-}
-
-void write_and_read_file(const std::string& file_path) {
-    std::ofstream ofs(file_path);
+#include "metadata_bench.h"
+#include "overhead_bench.h"
+#include "ramdisk_device.h"
+#include "bench_results.h"
+
+// Without `truncate` the file must exist (a memfd RAM disk cannot be truncated)
+void write_and_read_file(const std::string& file_path, bool truncate = true) {
+    std::ofstream ofs(file_path, truncate ? std::ios::out : std::ios::in | std::ios::out);
     if (!ofs) {
         std::cerr << "Error writing to " << file_path << std::endl;
         return;
     }
     ofs << "Hello from RAM!" << std::endl;
     ofs.close();
+    if (!ofs) {
+        // e.g. a huge page memfd, which can only be accessed through mmap
+        std::cerr << "Error writing to " << file_path << std::endl;
+        return;
+    }
 
     std::ifstream ifs(file_path);
     std::string line;
@@ -71,71 +31,133 @@ void write_and_read_file(const std::string& file_path) {
     std::cout << "Read: " << line << std::endl;
 }
 
-constexpr int FAILED_CREATE = 1; //Failed to create RAM disk device 
-constexpr int FAILED_MOUNT = 2; //Failed to mount RAM disk
-constexpr int DISK_NOT_FOUND = 3; //RAM disk not found in /Volumes
+struct Options {
+    bool ramdisk = true;
+    bool verbose = false;
+    std::string mode = "hello";
+    std::string path = ".";  // directory used when the RAM disk is off
+    RamdiskConfig ramdisk_config;
+    MetadataOptions meta;
+    OverheadOptions overhead;
+    MeasureOptions measure;
+    ResultsOptions results;
+    bool help = false;
+};
+
+void print_help(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [-m=hello|meta|compare] [-r=0|1] [-p=path] [-v]\n"
+              << "       [-b=hdiutil|shm|memfd] [-z=N] [-g=0|1] [-e=0|1]\n"
+              << "       [-j=N] [-f=N] [-s=N] [-d=N] [-w=N] [-k=N]\n"
+              << "       [--warmup=N] [--reps=N] [--keep-outliers] [--timer=monotonic|tsc]\n"
+              << "       [--json=FILE] [--csv=FILE] [--compare=FILE] [--threshold=N] [-h]\n"
+              << "  -m=hello Write and read a line in a file (default)\n"
+              << "  -m=meta  Metadata benchmark: create/write/fsync/stat/open-read/\n"
+              << "           rename/unlink of many small files\n"
+              << "  -m=compare  Sequential/random write/read on memory, the RAM disk\n"
+              << "           and the -p directory, with overhead vs raw memory\n"
+              << "  -r=0     Use the directory given by -p\n"
+              << "  -r=1     Use a RAM disk (default)\n"
+              << "  -p=path  Directory used with -r=0 (default: .)\n"
+              << "  -v       Verbose output\n"
+              << "  -b=hdiutil  RAM disk mounted with hdiutil/diskutil (macOS default)\n"
+              << "  -b=shm   RAM disk as a directory on /dev/shm (Linux default)\n"
+              << "  -b=memfd RAM disk as a single memfd_create file (Linux)\n"
+              << "  -z=N     RAM disk size in MB (default: 2047); for shm enforced only\n"
+              << "           when allowed to mount a tmpfs, otherwise advisory\n"
+              << "  -g=1     memfd: use huge pages (MFD_HUGETLB), default 0\n"
+              << "  -e=0     memfd: do not seal the size, default 1\n"
+              << "  -j=N     Number of threads for -m=meta (default: 4)\n"
+              << "  -f=N     Files per thread for -m=meta (default: 10000)\n"
+              << "  -s=N     File size in bytes for -m=meta (default: 4096)\n"
+              << "  -d=N     Directory fan-out per level for -m=meta (default: 16)\n"
+              << "  -w=N     Workload size in MB for -m=compare (default: 256)\n"
+              << "  -k=N     Random block size in bytes for -m=compare (default: 4096)\n"
+              << "  -h       Show this help message\n";
+    print_measure_help();
+    print_results_help();
+}
 
-int create_ramdisk(bool verbose) {
-    if (verbose) {
-        std::cout << "Creating RAM disk..." << std::endl;
-    }
-    // create a device in RAM
-    std::string device = create_ramdisk_device(RAMDISK_SIZE_MB, verbose);
-    if (device.empty()) {
-        return FAILED_CREATE;
-    }
-    if (verbose) {
-        std::cout << "Mounting RAM disk..." << std::endl;
-    }
-    if (!mount_ramdisk(device, VOLUME_NAME)) {
-        return FAILED_MOUNT;
-    }
-    // Wait a moment for the volume to appear in /Volumes
-    for (int i = 0; i < 10; ++i) {
-        if (is_ramdisk_mounted(MOUNT_PATH)) break;
-        usleep(100000); // 100 ms
-    }
-    // Check if the RAM disk is mounted
-    if (!is_ramdisk_mounted(MOUNT_PATH)) {
-        return DISK_NOT_FOUND;
-    }
-    if (verbose) {
-        std::cout << "RAM disk mounted at path: " << MOUNT_PATH << std::endl;
+Options parse_args(int argc, char* argv[]) {
+    Options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "-h") {
+            opts.help = true;
+        } else if (arg == "-v") {
+            opts.verbose = true;
+        } else if (arg.rfind("-m=", 0) == 0) {
+            opts.mode = arg.substr(3);
+            if (opts.mode != "hello" && opts.mode != "meta" && opts.mode != "compare") {
+                std::cerr << "Invalid value for -m: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-r=", 0) == 0) {
+            opts.ramdisk = std::stoi(arg.substr(3)) != 0;
+        } else if (arg.rfind("-b=", 0) == 0) {
+            if (!parse_ramdisk_backend(arg.substr(3), opts.ramdisk_config.backend)) {
+                std::cerr << "Invalid value for -b: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-z=", 0) == 0) {
+            opts.ramdisk_config.size_mb = std::stoi(arg.substr(3));
+        } else if (arg.rfind("-g=", 0) == 0) {
+            opts.ramdisk_config.hugetlb = std::stoi(arg.substr(3)) != 0;
+        } else if (arg.rfind("-e=", 0) == 0) {
+            opts.ramdisk_config.seal = std::stoi(arg.substr(3)) != 0;
+        } else if (arg.rfind("-p=", 0) == 0) {
+            opts.path = arg.substr(3);
+        } else if (arg.rfind("-j=", 0) == 0) {
+            opts.meta.threads = std::stoi(arg.substr(3));
+            if (opts.meta.threads <= 0) {
+                std::cerr << "Invalid value for -j: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-f=", 0) == 0) {
+            opts.meta.files_per_thread = std::stoi(arg.substr(3));
+            if (opts.meta.files_per_thread <= 0) {
+                std::cerr << "Invalid value for -f: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-s=", 0) == 0) {
+            opts.meta.file_size = std::stoul(arg.substr(3));
+        } else if (arg.rfind("-d=", 0) == 0) {
+            opts.meta.fanout = std::stoi(arg.substr(3));
+            if (opts.meta.fanout <= 0) {
+                std::cerr << "Invalid value for -d: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-w=", 0) == 0) {
+            opts.overhead.size_mb = std::stoul(arg.substr(3));
+        } else if (arg.rfind("-k=", 0) == 0) {
+            opts.overhead.random_block = std::stoul(arg.substr(3));
+        } else if (parse_measure_arg(arg, opts.measure)) {
+        } else if (parse_results_arg(arg, opts.results)) {
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            opts.help = true;
+        }
     }
-    return 0;
+
+    return opts;
 }
 
-constexpr int ERROR_EJECTING = 1; //Error ejecting RAM disk
-constexpr int RAMDISK_STILL_EXISTS = 2; //RAM disk still exists in /Volumes
+int main(int argc, char* argv[]) {
+    Options options = parse_args(argc, argv);
 
-int unmount_ramdisk(bool verbose) {
-    // Unmount the RAM disk
-    if(verbose) {
-        std::cout << "Ejecting RAM disk..." << std::endl;
-    }
-    if (eject_ramdisk(MOUNT_PATH)) {
-        if(verbose) {
-            std::cout << "RAM disk ejected." << std::endl;
-        }
-    } else {
-        return ERROR_EJECTING;
-    }
-    // Check if the RAM disk was successfully ejected
-    if (is_ramdisk_mounted(MOUNT_PATH)) {
-        return RAMDISK_STILL_EXISTS;
+    if (options.help) {
+        print_help(argv[0]);
+        return 0;
     }
-    if (verbose) {
-        std::cout << "RAM disk successfully removed." << std::endl;
-    }
-    return 0;
-}
 
-int main() {
-    bool verbose = false;
-    bool ramdisk = true;
+    init_timer(options.measure);
+    bool verbose = options.verbose;
+    bool ramdisk = options.ramdisk;
     std::string mount_path;
+    Ramdisk disk;
     if (ramdisk) {
-        int err = create_ramdisk(verbose);
+        int err = create_ramdisk(options.ramdisk_config, disk, verbose);
         switch (err) {
             case FAILED_CREATE: //Failed to create RAM disk device
             std::cerr << "Failed to create RAM disk device!" << std::endl;
@@ -143,32 +165,60 @@ int main() {
             case FAILED_MOUNT: //Failed to mount RAM disk
             std::cerr << "Failed to mount RAM disk!" << std::endl;
             return 1;
-            case DISK_NOT_FOUND: //RAM disk not found in /Volumes
-            std::cerr << "RAM disk not found in /Volumes!" << std::endl;
+            case DISK_NOT_FOUND: //RAM disk not found at its mount path
+            std::cerr << "RAM disk not found at " << disk.mount_path << "!" << std::endl;
             return 1;
         }
-        mount_path = MOUNT_PATH;
+        mount_path = disk.mount_path;
     }
     else {
-        mount_path = ".";
+        mount_path = options.path;
     }
     //===================
     const std::string TMPFILE_NAME = "tempfile.txt";
-
-    write_and_read_file(mount_path + "/" + TMPFILE_NAME);
+    bool benchmark_ok = true;
+    BenchResults results("ramdisk/" + options.mode);
+    results.set_path(mount_path);
+
+    if (options.mode == "meta") {
+        if (ramdisk && !ramdisk_is_directory(disk)) {
+            std::cerr << "The metadata benchmark needs a directory, use -b=shm" << std::endl;
+            benchmark_ok = false;
+        } else {
+            MetadataOptions meta = options.meta;
+            meta.base_path = mount_path;
+            benchmark_ok = run_metadata_benchmark(meta, options.measure, results, verbose);
+        }
+    } else if (options.mode == "compare") {
+        OverheadOptions overhead = options.overhead;
+        overhead.disk_file = options.path + "/overhead.bin";
+        if (ramdisk) {
+            overhead.ram_file = ramdisk_file_path(disk, "overhead.bin");
+        }
+        if (ramdisk && static_cast<size_t>(disk.config.size_mb) < overhead.size_mb) {
+            std::cerr << "The workload does not fit in the RAM disk" << std::endl;
+            benchmark_ok = false;
+        } else {
+            benchmark_ok = run_overhead_benchmark(overhead, options.measure, results, verbose);
+        }
+    } else if (ramdisk) {
+        write_and_read_file(ramdisk_file_path(disk, TMPFILE_NAME), ramdisk_is_directory(disk));
+    } else {
+        write_and_read_file(mount_path + "/" + TMPFILE_NAME);
+    }
     //===================
     if (ramdisk) {
-        int err = unmount_ramdisk(verbose);
+        int err = unmount_ramdisk(disk, verbose);
         switch (err) {
             case ERROR_EJECTING: //Error ejecting RAM disk
                 std::cerr << "Error ejecting RAM disk" << std::endl;
                 return 1;
-            case RAMDISK_STILL_EXISTS: //RAM disk still exists in /Volumes
-                std::cerr << "RAM disk still exists in /Volumes" << std::endl;
+            case RAMDISK_STILL_EXISTS: //RAM disk still exists after ejecting
+                std::cerr << "RAM disk still exists at " << disk.mount_path << std::endl;
                 return 1;
         }
     }
-    else {
+    else if (options.mode == "hello") {
         if(verbose) {
             std::cout << "A temporary file removing..." << std::endl;
         }
@@ -181,5 +231,8 @@ int main() {
             std::cout << "The temporary file removed successfully." << std::endl;
         }
     }
-    return 0;
+    if (!benchmark_ok) {
+        return 1;
+    }
+    return finish_results(results, options.results);
 }
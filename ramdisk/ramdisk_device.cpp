@@ -0,0 +1,319 @@
+#include "ramdisk_device.h"
+#include "bench_timer.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <ftw.h>
+#include <sys/mman.h>
+#include <sys/statfs.h>
+#include <sys/mount.h>
+#include <linux/magic.h>
+#endif
+
+bool parse_ramdisk_backend(const std::string& name, RamdiskBackend& backend) {
+    if (name == "hdiutil") {
+        backend = RamdiskBackend::Hdiutil;
+    } else if (name == "shm") {
+        backend = RamdiskBackend::ShmDir;
+    } else if (name == "memfd") {
+        backend = RamdiskBackend::Memfd;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* ramdisk_backend_name(RamdiskBackend backend) {
+    switch (backend) {
+        case RamdiskBackend::Hdiutil: return "hdiutil";
+        case RamdiskBackend::ShmDir: return "shm";
+        case RamdiskBackend::Memfd: return "memfd";
+    }
+    return "";
+}
+
+namespace {
+
+const std::string VOLUME_NAME = "RAMDisk";
+const std::string MOUNT_PATH = "/Volumes/" + VOLUME_NAME;
+
+//=================== macOS: hdiutil/diskutil ===================
+
+// Get the device ID for the RAM disk (e.g., /dev/disk3)
+std::string create_ramdisk_device(int size_mb, bool verbose) {
+    int blocks = size_mb * 1024 * 1024 / 512;
+    std::string cmd = "hdiutil attach -nomount ram://" + std::to_string(blocks);
+
+    FILE* pipe = popen(cmd.c_str(), "r");
+    if (!pipe) return "";
+
+    char buffer[128];
+    std::string result;
+    while (fgets(buffer, sizeof(buffer), pipe)) {
+        result += buffer;
+    }
+
+    pclose(pipe);
+    // Remove trailing spaces and newlines
+    result.erase(result.find_last_not_of(" \n\r\t") + 1);
+    if (verbose) {
+        std::cout << "Created RAM disk device: " << result << std::endl;
+    }
+    // Ensure the result is a valid device path
+    if (result.empty() || result.find("/dev/disk") == std::string::npos) {
+        return "";
+    }
+
+    return result;
+}
+
+// Format and mount the RAM disk as a volume
+bool mount_ramdisk(const std::string& device, const std::string& volume_name) {
+    std::string cmd = "diskutil erasevolume HFS+ " + volume_name + " " + device +
+                      " >/dev/null 2>&1";
+    return system(cmd.c_str()) == 0;
+}
+
+// Unmount and eject the RAM disk
+bool eject_ramdisk(const std::string& mount_path) {
+    std::string cmd = "diskutil eject \"" + mount_path + "\" >/dev/null 2>&1";
+    return system(cmd.c_str()) == 0;
+}
+
+// Check if the RAM disk exists in /Volumes
+bool is_ramdisk_mounted(const std::string& mount_path) {
+    return access(mount_path.c_str(), F_OK) == 0;
+}
+
+int create_hdiutil_ramdisk(Ramdisk& disk, bool verbose) {
+    // create a device in RAM
+    std::string device = create_ramdisk_device(disk.config.size_mb, verbose);
+    if (device.empty()) {
+        return FAILED_CREATE;
+    }
+    if (verbose) {
+        std::cout << "Mounting RAM disk..." << std::endl;
+    }
+    if (!mount_ramdisk(device, VOLUME_NAME)) {
+        return FAILED_MOUNT;
+    }
+    // Wait a moment for the volume to appear in /Volumes
+    for (int i = 0; i < 10; ++i) {
+        if (is_ramdisk_mounted(MOUNT_PATH)) break;
+        usleep(100000); // 100 ms
+    }
+    // Check if the RAM disk is mounted
+    if (!is_ramdisk_mounted(MOUNT_PATH)) {
+        return DISK_NOT_FOUND;
+    }
+    disk.mount_path = MOUNT_PATH;
+    return 0;
+}
+
+int unmount_hdiutil_ramdisk(Ramdisk& disk) {
+    if (!eject_ramdisk(disk.mount_path)) {
+        return ERROR_EJECTING;
+    }
+    // Check if the RAM disk was successfully ejected
+    if (is_ramdisk_mounted(disk.mount_path)) {
+        return RAMDISK_STILL_EXISTS;
+    }
+    return 0;
+}
+
+//=================== Linux: /dev/shm and memfd ===================
+
+#ifdef __linux__
+const std::string SHM_PATH = "/dev/shm";
+
+// /dev/shm is a tmpfs shared by the whole host with no per-directory quota.
+// When allowed to mount, a private tmpfs of the requested size is mounted on
+// the directory, so writes past the size fail with ENOSPC. Otherwise the size
+// is only checked against the free space of /dev/shm.
+int create_shm_ramdisk(Ramdisk& disk, bool verbose) {
+    struct statfs fs;
+    if (statfs(SHM_PATH.c_str(), &fs) != 0 || fs.f_type != TMPFS_MAGIC) {
+        std::cerr << SHM_PATH << " is not a tmpfs" << std::endl;
+        return FAILED_CREATE;
+    }
+    unsigned long long free_mb =
+        static_cast<unsigned long long>(fs.f_bavail) * fs.f_bsize / (1024 * 1024);
+    if (free_mb < static_cast<unsigned long long>(disk.config.size_mb)) {
+        std::cerr << "Only " << free_mb << " MB free in " << SHM_PATH << std::endl;
+        return FAILED_CREATE;
+    }
+
+    std::string path_template = SHM_PATH + "/" + VOLUME_NAME + "-XXXXXX";
+    if (!mkdtemp(&path_template[0])) {
+        perror("mkdtemp");
+        return FAILED_CREATE;
+    }
+    if (verbose) {
+        std::cout << "Created RAM disk directory: " << path_template << std::endl;
+    }
+    std::string options = "size=" + std::to_string(disk.config.size_mb) + "m,mode=0700";
+    if (mount("tmpfs", path_template.c_str(), "tmpfs", MS_NOSUID | MS_NODEV,
+              options.c_str()) == 0) {
+        disk.size_limited = true;
+        if (verbose) {
+            std::cout << "Mounted a " << disk.config.size_mb << " MB tmpfs on it" << std::endl;
+        }
+    } else if (errno == EPERM) {
+        std::cout << "No permission to mount a tmpfs: the RAM disk size is not enforced"
+                  << std::endl;
+    } else {
+        perror("mount tmpfs");
+        rmdir(path_template.c_str());
+        return FAILED_MOUNT;
+    }
+    disk.mount_path = path_template;
+    if (!is_ramdisk_mounted(path_template)) {
+        return DISK_NOT_FOUND;
+    }
+    return 0;
+}
+
+int unmount_shm_ramdisk(Ramdisk& disk) {
+    // Unmounting the private tmpfs frees its files at once
+    if (disk.size_limited && umount(disk.mount_path.c_str()) != 0) {
+        perror("umount");
+        return ERROR_EJECTING;
+    }
+    auto remove_entry = [](const char* path, const struct stat*, int, struct FTW*) {
+        return remove(path);
+    };
+    if (nftw(disk.mount_path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0) {
+        return ERROR_EJECTING;
+    }
+    if (is_ramdisk_mounted(disk.mount_path)) {
+        return RAMDISK_STILL_EXISTS;
+    }
+    return 0;
+}
+
+int create_memfd_ramdisk(Ramdisk& disk, bool verbose) {
+    unsigned int flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+    off_t size = static_cast<off_t>(disk.config.size_mb) * 1024 * 1024;
+    if (disk.config.hugetlb) {
+        flags |= MFD_HUGETLB;
+        // hugetlbfs files must be a multiple of the huge page size
+        constexpr off_t huge_page = 2 * 1024 * 1024;
+        size = (size + huge_page - 1) / huge_page * huge_page;
+    }
+    int fd = memfd_create(VOLUME_NAME.c_str(), flags);
+    if (fd < 0) {
+        perror("memfd_create");
+        return FAILED_CREATE;
+    }
+    if (ftruncate(fd, size) != 0) {
+        perror("ftruncate");
+        close(fd);
+        return FAILED_MOUNT;
+    }
+    // With the size sealed, writes beyond the end fail instead of growing the file
+    if (disk.config.seal && fcntl(fd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) != 0) {
+        perror("fcntl F_ADD_SEALS");
+        close(fd);
+        return FAILED_MOUNT;
+    }
+    disk.fd = fd;
+    disk.mount_path = "/proc/self/fd/" + std::to_string(fd);
+    if (verbose) {
+        std::cout << "Created memfd RAM disk: " << disk.mount_path
+                  << (disk.config.hugetlb ? " (huge pages)" : "")
+                  << (disk.config.seal ? " (size sealed)" : "") << std::endl;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != size) {
+        close(fd);
+        disk.fd = -1;
+        return DISK_NOT_FOUND;
+    }
+    return 0;
+}
+
+int unmount_memfd_ramdisk(Ramdisk& disk) {
+    // The memory is released with the last reference to the file
+    int err = close(disk.fd);
+    disk.fd = -1;
+    if (err != 0) {
+        perror("close memfd");
+        return ERROR_EJECTING;
+    }
+    return 0;
+}
+#endif
+
+} // namespace
+
+//=================== Lifecycle ===================
+
+int create_ramdisk(const RamdiskConfig& config, Ramdisk& disk, bool verbose) {
+    if (verbose) {
+        std::cout << "Creating RAM disk (" << ramdisk_backend_name(config.backend) << ")..."
+                  << std::endl;
+    }
+    double start = bench_now();
+    disk = Ramdisk();
+    disk.config = config;
+
+    int err = FAILED_CREATE;
+    switch (config.backend) {
+        case RamdiskBackend::Hdiutil:
+            err = create_hdiutil_ramdisk(disk, verbose);
+            break;
+#ifdef __linux__
+        case RamdiskBackend::ShmDir:
+            err = create_shm_ramdisk(disk, verbose);
+            break;
+        case RamdiskBackend::Memfd:
+            err = create_memfd_ramdisk(disk, verbose);
+            break;
+#endif
+        default:
+            std::cerr << "The " << ramdisk_backend_name(config.backend)
+                      << " RAM disk is not supported on this OS" << std::endl;
+            break;
+    }
+    if (err == 0 && verbose) {
+        std::cout << "RAM disk mounted at path: " << disk.mount_path << " in "
+                  << (bench_now() - start) * 1e3 << " ms"
+                  << std::endl;
+    }
+    return err;
+}
+
+int unmount_ramdisk(Ramdisk& disk, bool verbose) {
+    // Unmount the RAM disk
+    if(verbose) {
+        std::cout << "Ejecting RAM disk..." << std::endl;
+    }
+    int err = ERROR_EJECTING;
+    switch (disk.config.backend) {
+        case RamdiskBackend::Hdiutil:
+            err = unmount_hdiutil_ramdisk(disk);
+            break;
+#ifdef __linux__
+        case RamdiskBackend::ShmDir:
+            err = unmount_shm_ramdisk(disk);
+            break;
+        case RamdiskBackend::Memfd:
+            err = unmount_memfd_ramdisk(disk);
+            break;
+#endif
+        default:
+            break;
+    }
+    if (err == 0 && verbose) {
+        std::cout << "RAM disk successfully removed." << std::endl;
+    }
+    return err;
+}
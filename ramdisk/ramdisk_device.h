@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+
+// RAM disk size in megabytes
+constexpr int RAMDISK_SIZE_MB = 2047;
+
+enum class RamdiskBackend {
+    Hdiutil,  // macOS: RAM device from hdiutil, formatted and mounted by diskutil
+    ShmDir,   // Linux: private directory on the /dev/shm tmpfs
+    Memfd,    // Linux: single anonymous memfd_create file
+};
+
+#ifdef __linux__
+constexpr RamdiskBackend DEFAULT_RAMDISK_BACKEND = RamdiskBackend::ShmDir;
+#else
+constexpr RamdiskBackend DEFAULT_RAMDISK_BACKEND = RamdiskBackend::Hdiutil;
+#endif
+
+struct RamdiskConfig {
+    RamdiskBackend backend = DEFAULT_RAMDISK_BACKEND;
+    int size_mb = RAMDISK_SIZE_MB;
+    bool hugetlb = false;  // memfd: back the file with huge pages (MFD_HUGETLB)
+    bool seal = true;      // memfd: seal the size with F_SEAL_GROW | F_SEAL_SHRINK
+};
+
+struct Ramdisk {
+    RamdiskConfig config;
+    // Directory for Hdiutil and ShmDir; /proc/self/fd/N for Memfd
+    std::string mount_path;
+    int fd = -1;  // Memfd only
+    bool size_limited = false;  // ShmDir: a private tmpfs of size_mb is mounted on the directory
+};
+
+// A Memfd RAM disk is a single file, the other backends are directories
+inline bool ramdisk_is_directory(const Ramdisk& disk) {
+    return disk.config.backend != RamdiskBackend::Memfd;
+}
+
+// Path of a file named `name` on the RAM disk; a Memfd RAM disk has only one file
+inline std::string ramdisk_file_path(const Ramdisk& disk, const std::string& name) {
+    return ramdisk_is_directory(disk) ? disk.mount_path + "/" + name : disk.mount_path;
+}
+
+bool parse_ramdisk_backend(const std::string& name, RamdiskBackend& backend);
+const char* ramdisk_backend_name(RamdiskBackend backend);
+
+constexpr int FAILED_CREATE = 1; //Failed to create RAM disk device
+constexpr int FAILED_MOUNT = 2; //Failed to mount RAM disk
+constexpr int DISK_NOT_FOUND = 3; //RAM disk not found at its mount path
+
+// Create, mount and verify a RAM disk; fills `disk` on success.
+// Returns 0 or one of the error codes above.
+int create_ramdisk(const RamdiskConfig& config, Ramdisk& disk, bool verbose);
+
+constexpr int ERROR_EJECTING = 1; //Error ejecting RAM disk
+constexpr int RAMDISK_STILL_EXISTS = 2; //RAM disk still exists after ejecting
+
+// Eject the RAM disk and release its memory.
+// Returns 0 or one of the error codes above.
+int unmount_ramdisk(Ramdisk& disk, bool verbose);
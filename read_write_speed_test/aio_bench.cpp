@@ -0,0 +1,366 @@
+#include "aio_bench.h"
+#include "latency_histogram.h"
+#include "rw_common.h"
+#include "bench_results.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/aio_abi.h>
+#include <sys/syscall.h>
+#endif
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct EngineRun {
+    bool ok = true;
+    std::string failure;
+    double seconds = 0;
+    size_t errors = 0;  // I/Os that transferred less than a block
+    LatencyHistogram histogram;  // submit to completion, ns
+};
+
+using Engine = std::function<EngineRun(int fd, const std::vector<off_t>& offsets, bool is_read,
+                                       size_t block, int queue_depth, int batch)>;
+
+uint64_t elapsed_ns(double from, double to) {
+    return static_cast<uint64_t>((to - from) * 1e9);
+}
+
+// One aligned buffer per outstanding I/O
+class AlignedBuffers {
+public:
+    AlignedBuffers(int count, size_t size) {
+        for (int i = 0; i < count; ++i) {
+            void* p = nullptr;
+            if (posix_memalign(&p, DIRECT_ALIGNMENT, size) != 0) {
+                break;
+            }
+            std::memset(p, 'A' + i % 26, size);
+            buffers_.push_back(static_cast<char*>(p));
+        }
+        ok_ = static_cast<int>(buffers_.size()) == count;
+    }
+    ~AlignedBuffers() {
+        for (char* p : buffers_) {
+            free(p);
+        }
+    }
+    AlignedBuffers(const AlignedBuffers&) = delete;
+    AlignedBuffers& operator=(const AlignedBuffers&) = delete;
+
+    bool ok() const { return ok_; }
+    char* operator[](size_t i) const { return buffers_[i]; }
+
+private:
+    std::vector<char*> buffers_;
+    bool ok_ = false;
+};
+
+#ifdef __linux__
+// glibc has no wrappers for the native AIO syscalls (libaio provides them)
+long sys_io_setup(unsigned nr_events, aio_context_t* ctx) {
+    return syscall(SYS_io_setup, nr_events, ctx);
+}
+
+long sys_io_destroy(aio_context_t ctx) {
+    return syscall(SYS_io_destroy, ctx);
+}
+
+long sys_io_submit(aio_context_t ctx, long nr, iocb** iocbpp) {
+    return syscall(SYS_io_submit, ctx, nr, iocbpp);
+}
+
+long sys_io_getevents(aio_context_t ctx, long min_nr, long nr, io_event* events) {
+    return syscall(SYS_io_getevents, ctx, min_nr, nr, events, nullptr);
+}
+
+// Keeps up to `queue_depth` I/Os in flight. New iocbs are submitted
+// `batch` at a time (or fewer when the queue is full or the run ends), and
+// completions are reaped `batch` at a time, so both syscalls are amortized
+// over a batch.
+EngineRun run_native_aio(int fd, const std::vector<off_t>& offsets, bool is_read, size_t block,
+                         int queue_depth, int batch) {
+    EngineRun run;
+    AlignedBuffers buffers(queue_depth, block);
+    if (!buffers.ok()) {
+        run.ok = false;
+        run.failure = "memory allocation failed";
+        return run;
+    }
+    aio_context_t ctx = 0;
+    if (sys_io_setup(queue_depth, &ctx) < 0) {
+        run.ok = false;
+        run.failure = std::string("io_setup: ") + std::strerror(errno);
+        return run;
+    }
+
+    std::vector<iocb> cbs(queue_depth);
+    std::vector<double> issued(queue_depth);
+    std::vector<int> free_slots;
+    for (int i = queue_depth - 1; i >= 0; --i) {
+        free_slots.push_back(i);
+    }
+    std::vector<iocb*> pending;
+    std::vector<io_event> events(queue_depth);
+    size_t next = 0;
+    size_t done = 0;
+    long inflight = 0;
+
+    double start = bench_now();
+    while (run.ok && done < offsets.size()) {
+        while (!free_slots.empty() && next < offsets.size()) {
+            int slot = free_slots.back();
+            free_slots.pop_back();
+            iocb& cb = cbs[slot];
+            std::memset(&cb, 0, sizeof(cb));
+            cb.aio_data = slot;
+            cb.aio_lio_opcode = is_read ? IOCB_CMD_PREAD : IOCB_CMD_PWRITE;
+            cb.aio_fildes = fd;
+            cb.aio_buf = reinterpret_cast<uintptr_t>(buffers[slot]);
+            cb.aio_nbytes = block;
+            cb.aio_offset = offsets[next++];
+            pending.push_back(&cb);
+
+            bool full_batch = static_cast<int>(pending.size()) == batch;
+            if (!full_batch && !free_slots.empty() && next < offsets.size()) {
+                continue;
+            }
+            double now = bench_now();
+            for (iocb* p : pending) {
+                issued[p->aio_data] = now;
+            }
+            // io_submit may accept only a part of the batch
+            for (size_t sent = 0; sent < pending.size();) {
+                long n = sys_io_submit(ctx, pending.size() - sent, pending.data() + sent);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    run.ok = false;
+                    run.failure = std::string("io_submit: ") + std::strerror(n < 0 ? errno : EIO);
+                    break;
+                }
+                sent += n;
+                inflight += n;
+            }
+            pending.clear();
+            if (!run.ok) {
+                break;
+            }
+        }
+        if (inflight == 0) {
+            break;
+        }
+
+        long n = sys_io_getevents(ctx, std::min<long>(batch, inflight), queue_depth, events.data());
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            run.ok = false;
+            run.failure = std::string("io_getevents: ") + std::strerror(errno);
+            break;
+        }
+        double now = bench_now();
+        for (long i = 0; i < n; ++i) {
+            int slot = static_cast<int>(events[i].data);
+            if (events[i].res != static_cast<long long>(block)) {
+                ++run.errors;
+            }
+            run.histogram.record(elapsed_ns(issued[slot], now));
+            free_slots.push_back(slot);
+        }
+        inflight -= n;
+        done += n;
+    }
+    run.seconds = bench_now() - start;
+
+    // Wait for what is still in flight after an error before the buffers go away
+    while (inflight > 0) {
+        long n = sys_io_getevents(ctx, inflight, queue_depth, events.data());
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+        inflight -= std::max(0L, n);
+    }
+    sys_io_destroy(ctx);
+    return run;
+}
+#endif
+
+// `queue_depth` threads, each with one blocking pread/pwrite in flight
+EngineRun run_thread_pool(int fd, const std::vector<off_t>& offsets, bool is_read, size_t block,
+                          int queue_depth, int) {
+    EngineRun run;
+    AlignedBuffers buffers(queue_depth, block);
+    if (!buffers.ok()) {
+        run.ok = false;
+        run.failure = "memory allocation failed";
+        return run;
+    }
+    std::atomic<size_t> next{0};
+    std::vector<EngineRun> partial(queue_depth);
+    std::vector<std::thread> threads;
+
+    double start = bench_now();
+    for (int t = 0; t < queue_depth; ++t) {
+        threads.emplace_back([&, t]() {
+            EngineRun& mine = partial[t];
+            for (size_t i = next++; i < offsets.size(); i = next++) {
+                double issued = bench_now();
+                ssize_t n = is_read ? pread(fd, buffers[t], block, offsets[i])
+                                    : pwrite(fd, buffers[t], block, offsets[i]);
+                mine.histogram.record(elapsed_ns(issued, bench_now()));
+                if (n != static_cast<ssize_t>(block)) {
+                    ++mine.errors;
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    run.seconds = bench_now() - start;
+    for (const EngineRun& p : partial) {
+        run.histogram.merge(p.histogram);
+        run.errors += p.errors;
+    }
+    return run;
+}
+
+struct EngineInfo {
+    const char* name;
+    Engine engine;
+    bool batched;  // submits and reaps in batches
+};
+
+std::vector<EngineInfo> engines() {
+    std::vector<EngineInfo> list;
+#ifdef __linux__
+    list.push_back({"aio", run_native_aio, true});
+#endif
+    list.push_back({"threads", run_thread_pool, false});
+    return list;
+}
+
+bool run_engine(const EngineInfo& engine, int fd, const std::vector<off_t>& offsets,
+                bool is_read, size_t block, int queue_depth, int batch,
+                const MeasureOptions& measure_opts, BenchResults& results) {
+    std::vector<double> iops, mean_us, p50_us, p99_us;
+    size_t errors = 0;
+    EngineRun failed;
+    measure(measure_opts, [&](bool measured) {
+        EngineRun run = engine.engine(fd, offsets, is_read, block, queue_depth, batch);
+        if (!run.ok) {
+            failed = run;
+            return false;
+        }
+        if (measured) {
+            // Short or failed I/Os do not count as done
+            iops.push_back((offsets.size() - run.errors) / run.seconds);
+            mean_us.push_back(run.histogram.mean() / 1e3);
+            p50_us.push_back(run.histogram.value_at_percentile(50) / 1e3);
+            p99_us.push_back(run.histogram.value_at_percentile(99) / 1e3);
+            errors += run.errors;
+        }
+        return true;
+    });
+
+    const char* workload = is_read ? "rand read" : "rand write";
+    std::cout << "Engine: " << engine.name << " | Workload: " << workload
+              << " | QD: " << queue_depth;
+    if (engine.batched) {
+        std::cout << " | Batch: " << batch;
+    }
+    std::cout << " | ";
+    if (!failed.ok) {
+        std::cout << "failed: " << failed.failure << "\n";
+        return false;
+    }
+    bool reject = measure_opts.reject_outliers;
+    Summary rate = summarize(iops, reject);
+    std::cout << "IOPS: " << rate
+              << " | MB/s: " << rate.median * block / MB
+              << " | avg: " << summarize(mean_us, reject).median << " us"
+              << " | p50: " << summarize(p50_us, reject).median << " us"
+              << " | p99: " << summarize(p99_us, reject).median << " us";
+    if (errors > 0) {
+        std::cout << " | errors: " << errors;
+    }
+    std::cout << "\n";
+
+    auto add = [&](const std::string& metric, const std::vector<double>& values,
+                   const std::string& unit) {
+        BenchResult& r = results.add(workload, metric, summarize(values, reject), unit)
+            .param("engine", engine.name).param("queue_depth", queue_depth)
+            .param("block_size", block);
+        if (engine.batched) {
+            r.param("batch", batch);
+        }
+    };
+    add("iops", iops, "IOPS");
+    add("p50", p50_us, "us");
+    add("p99", p99_us, "us");
+    return true;
+}
+
+} // namespace
+
+bool run_aio_benchmark(const AioOptions& opts, const MeasureOptions& measure_opts,
+                       BenchResults& results) {
+    size_t file_size = opts.size_mb * MB;
+    size_t block = opts.block_size;
+    if (block == 0 || block % DIRECT_ALIGNMENT != 0 || block > file_size) {
+        std::cerr << "The block size must be a multiple of " << DIRECT_ALIGNMENT
+                  << " bytes and fit in the file\n";
+        return false;
+    }
+
+    std::cout << "Preparing " << opts.size_mb << " MB test file...\n";
+    if (!write_test_file(opts.path, file_size)) {
+        return false;
+    }
+    bool direct = false;
+    int fd = open_test_file(opts.path, direct);
+    if (fd < 0) {
+        perror("open");
+        unlink(opts.path.c_str());
+        return false;
+    }
+
+    // One pass worth of random blocks, the same for every engine
+    size_t blocks = file_size / block;
+    std::vector<off_t> offsets(blocks);
+    std::mt19937_64 rng(42);
+    for (off_t& offset : offsets) {
+        offset = static_cast<off_t>(rng() % blocks * block);
+    }
+
+    std::cout << "I/O: " << (direct ? "O_DIRECT" : "buffered (io_submit blocks without O_DIRECT)")
+              << " | Block: " << block << " B | I/Os per run: " << blocks << "\n";
+
+    bool ok = true;
+    for (bool is_read : {true, false}) {
+        for (int queue_depth : opts.queue_depths) {
+            int batch = std::min(opts.batch, queue_depth);
+            for (const EngineInfo& engine : engines()) {
+                ok = run_engine(engine, fd, offsets, is_read, block, queue_depth, batch,
+                                measure_opts, results) && ok;
+            }
+        }
+    }
+
+    close(fd);
+    unlink(opts.path.c_str());
+    return ok;
+}
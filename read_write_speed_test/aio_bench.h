@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class BenchResults;
+struct MeasureOptions;
+
+struct AioOptions {
+    std::string path;                     // test file
+    size_t size_mb = 1024;                // size of the test file
+    size_t block_size = 4096;             // size of one I/O
+    std::vector<int> queue_depths = {32}; // outstanding I/Os
+    int batch = 8;                        // iocbs per io_submit call
+};
+
+// Random reads and writes of the test file with Linux native AIO
+// (io_setup/io_submit/io_getevents on an O_DIRECT file) against a pool of
+// threads issuing pread/pwrite, with the same number of outstanding I/Os.
+// Prints IOPS, MB/s and completion latency for every engine and queue depth.
+// Returns false if the block size is invalid or the test could not run.
+bool run_aio_benchmark(const AioOptions& opts, const MeasureOptions& measure_opts,
+                       BenchResults& results);
@@ -0,0 +1,278 @@
+#include "copy_bench.h"
+#include "rw_common.h"
+#include "bench_results.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+// Copies `size` bytes from `in` to `out`. Returns false and leaves errno set on failure.
+using CopyFn = std::function<bool(int in, int out, size_t size)>;
+
+struct CopyMethod {
+    std::string name;
+    CopyFn fn;
+};
+
+bool copy_read_write(int in, int out, size_t size, size_t buffer_size) {
+    std::vector<char> buffer(buffer_size);
+    size_t copied = 0;
+    while (copied < size) {
+        ssize_t n = read(in, buffer.data(), std::min(buffer_size, size - copied));
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            return false;
+        }
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(out, buffer.data() + done, n - done);
+            if (w <= 0) return false;
+            done += w;
+        }
+        copied += n;
+    }
+    return true;
+}
+
+#ifdef __linux__
+bool copy_copy_file_range(int in, int out, size_t size) {
+    size_t copied = 0;
+    while (copied < size) {
+        ssize_t n = copy_file_range(in, nullptr, out, nullptr, size - copied, 0);
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            return false;
+        }
+        copied += n;
+    }
+    return true;
+}
+
+bool copy_sendfile(int in, int out, size_t size) {
+    // sendfile() transfers at most 0x7ffff000 bytes per call
+    constexpr size_t max_chunk = 0x7ffff000;
+    off_t offset = 0;
+    while (static_cast<size_t>(offset) < size) {
+        ssize_t n = sendfile(out, in, &offset, std::min(max_chunk, size - offset));
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool copy_splice(int in, int out, size_t size) {
+    int pipefd[2];
+    if (pipe(pipefd) != 0) return false;
+    // A bigger pipe means fewer splice() round trips; ignore failure,
+    // the default 64 KB pipe still works.
+    fcntl(pipefd[1], F_SETPIPE_SZ, static_cast<int>(MB));
+
+    bool ok = true;
+    size_t copied = 0;
+    while (ok && copied < size) {
+        ssize_t n = splice(in, nullptr, pipefd[1], nullptr, std::min(MB, size - copied),
+                           SPLICE_F_MOVE);
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            ok = false;
+            break;
+        }
+        for (ssize_t left = n; left > 0;) {
+            ssize_t w = splice(pipefd[0], nullptr, out, nullptr, left, SPLICE_F_MOVE);
+            if (w <= 0) {
+                ok = false;
+                break;
+            }
+            left -= w;
+        }
+        copied += n;
+    }
+    int saved_errno = errno;
+    close(pipefd[0]);
+    close(pipefd[1]);
+    errno = saved_errno;
+    return ok;
+}
+#endif
+
+bool copy_mmap(int in, int out, size_t size) {
+    if (ftruncate(out, size) != 0) return false;
+
+    void* src = mmap(nullptr, size, PROT_READ, MAP_SHARED, in, 0);
+    if (src == MAP_FAILED) return false;
+    void* dst = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, out, 0);
+    if (dst == MAP_FAILED) {
+        munmap(src, size);
+        return false;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(src, size, MADV_SEQUENTIAL);
+#endif
+    std::memcpy(dst, src, size);
+    bool ok = msync(dst, size, MS_SYNC) == 0;
+    munmap(dst, size);
+    munmap(src, size);
+    return ok;
+}
+
+std::vector<CopyMethod> copy_methods() {
+    std::vector<CopyMethod> methods;
+    for (size_t buffer_size : {4 * 1024UL, 64 * 1024UL, MB, 8 * MB}) {
+        std::string name = "read/write " + std::to_string(buffer_size / 1024) + "K";
+        methods.push_back({name, [buffer_size](int in, int out, size_t size) {
+            return copy_read_write(in, out, size, buffer_size);
+        }});
+    }
+#ifdef __linux__
+    methods.push_back({"copy_file_range", copy_copy_file_range});
+    methods.push_back({"sendfile", copy_sendfile});
+    methods.push_back({"splice", copy_splice});
+#endif
+    methods.push_back({"mmap+memcpy", copy_mmap});
+    return methods;
+}
+
+// Errors that mean "this method cannot copy between these two files"
+// rather than an I/O failure.
+bool is_unsupported(int err) {
+    return err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EINVAL;
+}
+
+struct CopyRun {
+    double speed = 0;     // MB/s
+    double user = 0;      // CPU time, s
+    double sys = 0;
+    int err = 0;          // errno of a failed copy
+    std::string failure;  // why a copy failed, empty on success
+};
+
+CopyRun copy_once(const CopyMethod& method, const std::string& src, const std::string& dst,
+                  size_t size) {
+    CopyRun run;
+    int in = open(src.c_str(), O_RDONLY);
+    if (in < 0) {
+        run.err = errno;
+        run.failure = std::string("open source: ") + std::strerror(run.err);
+        return run;
+    }
+    int out = open(dst.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0666);
+    if (out < 0) {
+        run.err = errno;
+        run.failure = std::string("open destination: ") + std::strerror(run.err);
+        close(in);
+        return run;
+    }
+    // Start every method with a cold source
+    set_nocache(in);
+
+    CpuTimes cpu_start = get_cpu_times();
+    double start = bench_now();
+    bool ok = method.fn(in, out, size);
+    int err = errno;
+    // The copy is timed up to durable, so a failed fsync fails the run
+    bool synced = !ok || fsync(out) == 0;
+    if (!synced) {
+        ok = false;
+        err = errno;
+    }
+    double end = bench_now();
+    CpuTimes cpu_end = get_cpu_times();
+
+    struct stat st{};
+    fstat(out, &st);
+    close(out);
+    close(in);
+
+    if (!ok) {
+        run.err = err;
+        run.failure = std::string(synced ? "" : "fsync: ") + std::strerror(err);
+    } else if (static_cast<size_t>(st.st_size) != size) {
+        run.failure = "destination size " + std::to_string(st.st_size) + " != " +
+                      std::to_string(size);
+    }
+    run.speed = (size / static_cast<double>(MB)) / (end - start);
+    run.user = cpu_end.user - cpu_start.user;
+    run.sys = cpu_end.sys - cpu_start.sys;
+    return run;
+}
+
+void run_method(const CopyMethod& method, const std::string& src, const std::string& dst,
+                size_t size, const MeasureOptions& measure_opts, BenchResults& results) {
+    std::vector<double> speeds, user, sys;
+    CopyRun failed;
+    measure(measure_opts, [&](bool measured) {
+        CopyRun run = copy_once(method, src, dst, size);
+        if (!run.failure.empty()) {
+            failed = run;
+            return false;
+        }
+        if (measured) {
+            speeds.push_back(run.speed);
+            user.push_back(run.user);
+            sys.push_back(run.sys);
+        }
+        return true;
+    });
+
+    std::cout << "Method: " << method.name << " | ";
+    if (!failed.failure.empty()) {
+        std::cout << (failed.err && is_unsupported(failed.err) ? "unsupported: " : "failed: ")
+                  << failed.failure << "\n";
+        return;
+    }
+    Summary speed = summarize(speeds, measure_opts.reject_outliers);
+    Summary user_time = summarize(user, measure_opts.reject_outliers);
+    Summary sys_time = summarize(sys, measure_opts.reject_outliers);
+    std::cout << "Copy: " << speed << " MB/s | "
+              << "user: " << user_time.median << " s | "
+              << "sys: " << sys_time.median << " s\n";
+    results.add("copy", "throughput", speed, "MB/s").param("method", method.name);
+    results.add("copy", "user_cpu", user_time, "s").param("method", method.name);
+    results.add("copy", "sys_cpu", sys_time, "s").param("method", method.name);
+}
+
+} // namespace
+
+void run_copy_benchmark(const CopyOptions& opts, const MeasureOptions& measure_opts,
+                        BenchResults& results) {
+    std::string src = opts.src;
+    bool generated = false;
+    if (src.empty()) {
+        src = opts.dst + ".src";
+        std::cout << "Creating source file " << src << " (" << opts.size_mb << " MB)...\n";
+        if (!write_test_file(src, opts.size_mb * MB)) {
+            return;
+        }
+        generated = true;
+    }
+
+    struct stat st{};
+    if (stat(src.c_str(), &st) != 0) {
+        perror("stat source");
+        return;
+    }
+    size_t size = st.st_size;
+    std::cout << "Copy " << src << " -> " << opts.dst << ", "
+              << size / static_cast<double>(MB) << " MB\n";
+
+    for (const CopyMethod& method : copy_methods()) {
+        run_method(method, src, opts.dst, size, measure_opts, results);
+    }
+
+    unlink(opts.dst.c_str());
+    if (generated) {
+        unlink(src.c_str());
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class BenchResults;
+struct MeasureOptions;
+
+struct CopyOptions {
+    std::string src;        // source file; generated when empty
+    std::string dst;        // destination file
+    size_t size_mb = 1024;  // size of the generated source file
+};
+
+// Copy a file with every available method (read/write with several buffer
+// sizes, copy_file_range, sendfile, splice, mmap+memcpy) and print
+// throughput and CPU time for each of them.
+void run_copy_benchmark(const CopyOptions& opts, const MeasureOptions& measure_opts,
+                        BenchResults& results);
@@ -0,0 +1,253 @@
+#include "durability_bench.h"
+#include "rw_common.h"
+#include "bench_results.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+enum class SyncMode {
+    None,           // buffered writes, one fsync at the end
+    Fsync,          // fsync after every commit
+    Fdatasync,      // fdatasync after every commit
+    OpenDsync,      // file opened with O_DSYNC
+    OpenSync,       // file opened with O_SYNC
+    SyncFileRange,  // sync_file_range(WRITE) after every commit, fdatasync at the end
+};
+
+enum class Prep {
+    Append,     // empty file that grows with every commit
+    Sparse,     // ftruncate to the final size, blocks allocated on write
+    Fallocate,  // blocks preallocated with fallocate
+    Overwrite,  // fully written file, overwritten in place
+};
+
+struct SyncModeInfo {
+    SyncMode mode;
+    const char* name;
+};
+
+struct PrepInfo {
+    Prep prep;
+    const char* name;
+};
+
+std::vector<SyncModeInfo> sync_modes() {
+    return {
+        {SyncMode::None, "none"},
+        {SyncMode::Fsync, "fsync"},
+#ifdef __linux__
+        {SyncMode::Fdatasync, "fdatasync"},
+#endif
+        {SyncMode::OpenDsync, "O_DSYNC"},
+        {SyncMode::OpenSync, "O_SYNC"},
+#ifdef __linux__
+        {SyncMode::SyncFileRange, "sync_file_range"},
+#endif
+    };
+}
+
+std::vector<PrepInfo> preps() {
+    return {
+        {Prep::Append, "append"},
+        {Prep::Sparse, "sparse"},
+#ifdef __linux__
+        {Prep::Fallocate, "fallocate"},
+#endif
+        {Prep::Overwrite, "overwrite"},
+    };
+}
+
+// Make the data written so far durable (used by per-commit and final syncs)
+int data_sync(int fd) {
+#ifdef __linux__
+    return fdatasync(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+bool prepare_file(const std::string& path, Prep prep, size_t size) {
+    if (prep == Prep::Overwrite) {
+        return write_test_file(path, size);
+    }
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror("open prepare");
+        return false;
+    }
+    bool ok = true;
+    if (prep == Prep::Sparse) {
+        ok = ftruncate(fd, size) == 0;
+    }
+#ifdef __linux__
+    if (prep == Prep::Fallocate) {
+        ok = fallocate(fd, 0, 0, size) == 0;
+    }
+#endif
+    if (!ok) {
+        perror("prepare");
+    } else if (fsync(fd) != 0) {
+        // The commits must not pay for flushing the preparation
+        perror("fsync prepare");
+        ok = false;
+    }
+    close(fd);
+    return ok;
+}
+
+struct CommitRun {
+    double commit_rate = 0;  // commits/s
+    double speed = 0;        // MB/s
+    std::vector<double> latencies;  // per commit, seconds, sorted
+};
+
+bool commit_once(const std::string& path, const SyncModeInfo& sync, const PrepInfo& prep,
+                 size_t commit_size, size_t total_size, CommitRun& run) {
+    size_t commits = total_size / commit_size;
+    if (!prepare_file(path, prep.prep, commits * commit_size)) {
+        return false;
+    }
+
+    int flags = O_WRONLY;
+    if (sync.mode == SyncMode::OpenDsync) flags |= O_DSYNC;
+    if (sync.mode == SyncMode::OpenSync) flags |= O_SYNC;
+    int fd = open(path.c_str(), flags);
+    if (fd < 0) {
+        perror("open durability");
+        return false;
+    }
+
+    std::vector<char> buffer(commit_size, 'W');
+    std::vector<double>& latencies = run.latencies;
+    latencies.clear();
+    latencies.reserve(commits);
+
+    double start = bench_now();
+    for (size_t i = 0; i < commits; ++i) {
+        off_t offset = static_cast<off_t>(i * commit_size);
+        double commit_start = bench_now();
+        if (pwrite(fd, buffer.data(), commit_size, offset) != static_cast<ssize_t>(commit_size)) {
+            perror("pwrite");
+            close(fd);
+            return false;
+        }
+        int err = 0;
+        switch (sync.mode) {
+            case SyncMode::Fsync:
+                err = fsync(fd);
+                break;
+            case SyncMode::Fdatasync:
+                err = data_sync(fd);
+                break;
+#ifdef __linux__
+            case SyncMode::SyncFileRange:
+                err = sync_file_range(fd, offset, commit_size, SYNC_FILE_RANGE_WRITE);
+                break;
+#endif
+            default:
+                break;
+        }
+        if (err != 0) {
+            perror("sync");
+            close(fd);
+            return false;
+        }
+        latencies.push_back(bench_now() - commit_start);
+    }
+    int final_err = 0;
+    if (sync.mode == SyncMode::None) {
+        final_err = fsync(fd);
+    } else if (sync.mode == SyncMode::SyncFileRange) {
+        final_err = data_sync(fd);
+    }
+    if (final_err != 0) {
+        perror("final sync");
+        close(fd);
+        return false;
+    }
+    double elapsed = bench_now() - start;
+    close(fd);
+
+    std::sort(latencies.begin(), latencies.end());
+    run.commit_rate = commits / elapsed;
+    run.speed = (commits * commit_size / static_cast<double>(MB)) / elapsed;
+    return true;
+}
+
+// Commit rate and latency percentiles are taken per run; with repetitions the
+// median of the runs is printed.
+void run_one(const std::string& path, const SyncModeInfo& sync, const PrepInfo& prep,
+             size_t commit_size, size_t total_size, const MeasureOptions& measure_opts,
+             BenchResults& results) {
+    std::vector<double> rate, speed, p50, p90, p99, p999, max;
+    bool ok = measure(measure_opts, [&](bool measured) {
+        CommitRun run;
+        if (!commit_once(path, sync, prep, commit_size, total_size, run)) {
+            return false;
+        }
+        if (measured) {
+            rate.push_back(run.commit_rate);
+            speed.push_back(run.speed);
+            p50.push_back(percentile(run.latencies, 50) * 1e6);
+            p90.push_back(percentile(run.latencies, 90) * 1e6);
+            p99.push_back(percentile(run.latencies, 99) * 1e6);
+            p999.push_back(percentile(run.latencies, 99.9) * 1e6);
+            max.push_back(run.latencies.back() * 1e6);
+        }
+        return true;
+    });
+    if (!ok) {
+        return;
+    }
+
+    bool reject = measure_opts.reject_outliers;
+    Summary commit_rate = summarize(rate, reject);
+    std::cout << "Sync: " << sync.name << " | Prep: " << prep.name
+              << " | Commit: " << commit_size << " B"
+              << " | Commits/s: " << commit_rate
+              << " | MB/s: " << summarize(speed, reject).median
+              << " | p50: " << summarize(p50, reject).median << " us"
+              << " | p90: " << summarize(p90, reject).median << " us"
+              << " | p99: " << summarize(p99, reject).median << " us"
+              << " | p99.9: " << summarize(p999, reject).median << " us"
+              << " | max: " << summarize(max, reject).median << " us\n";
+
+    auto add = [&](const std::string& metric, const std::vector<double>& values,
+                   const std::string& unit) {
+        results.add("commit", metric, summarize(values, reject), unit)
+            .param("sync", sync.name).param("prep", prep.name).param("commit_size", commit_size);
+    };
+    add("commit_rate", rate, "commits/s");
+    add("throughput", speed, "MB/s");
+    add("p50", p50, "us");
+    add("p90", p90, "us");
+    add("p99", p99, "us");
+    add("p99.9", p999, "us");
+    add("max", max, "us");
+}
+
+} // namespace
+
+void run_durability_benchmark(const DurabilityOptions& opts, const MeasureOptions& measure_opts,
+                              BenchResults& results) {
+    size_t total_size = opts.size_mb * MB;
+    for (size_t commit_size : opts.commit_sizes) {
+        if (commit_size == 0 || commit_size > total_size) {
+            std::cerr << "Invalid commit size: " << commit_size << "\n";
+            continue;
+        }
+        for (const SyncModeInfo& sync : sync_modes()) {
+            for (const PrepInfo& prep : preps()) {
+                run_one(opts.path, sync, prep, commit_size, total_size, measure_opts, results);
+            }
+        }
+    }
+    unlink(opts.path.c_str());
+}
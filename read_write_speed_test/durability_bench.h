@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class BenchResults;
+struct MeasureOptions;
+
+struct DurabilityOptions {
+    std::string path;                         // test file
+    size_t size_mb = 64;                      // data written per run
+    std::vector<size_t> commit_sizes = {4096}; // bytes made durable per commit
+};
+
+// Write the file as a sequence of commits for every combination of
+// durability mode (fsync/fdatasync per commit, O_DSYNC, O_SYNC,
+// sync_file_range) and file preparation (append, sparse, fallocate,
+// overwrite), printing commits/s and per-commit latency percentiles.
+void run_durability_benchmark(const DurabilityOptions& opts, const MeasureOptions& measure_opts,
+                              BenchResults& results);
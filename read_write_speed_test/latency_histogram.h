@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "bench_timer.h"
+
+// Log-linear latency histogram in the spirit of HdrHistogram: values are
+// grouped by their highest set bit and every power of two is split into
+// 2^SUB_BITS linear sub-buckets, so the relative error is below 1/2^SUB_BITS
+// for any value while recording stays O(1) and lock free per thread.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 7;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+
+    LatencyHistogram() : counts_(64 * SUB_BUCKETS, 0) {}
+
+    void record(uint64_t value) {
+        ++counts_[index_of(value)];
+        ++total_;
+        max_ = std::max(max_, value);
+        sum_ += value;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+        sum_ += other.sum_;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? static_cast<double>(sum_) / total_ : 0.0; }
+
+    // Smallest recorded value such that `percentile` % of the values are at
+    // or below it (the bucket of percentile_rank())
+    uint64_t value_at_percentile(double percentile) const {
+        if (total_ == 0) return 0;
+        uint64_t target = percentile_rank(total_, percentile);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= target) {
+                return std::min(highest_value_of(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static size_t index_of(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SUB_BITS;
+        size_t sub = static_cast<size_t>(value >> shift) - SUB_BUCKETS;
+        return static_cast<size_t>(shift + 1) * SUB_BUCKETS + sub;
+    }
+
+    // Largest value that maps to bucket `index`
+    static uint64_t highest_value_of(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+        uint64_t sub = index % SUB_BUCKETS + SUB_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+    uint64_t sum_ = 0;
+};
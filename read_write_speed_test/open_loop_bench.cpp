@@ -0,0 +1,207 @@
+#include "open_loop_bench.h"
+#include "latency_histogram.h"
+#include "rw_common.h"
+#include "bench_results.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Schedule {
+    Clock::time_point start;
+    Clock::time_point end;        // no operation is intended at or after this point
+    Clock::time_point hard_stop;  // operations still waiting at this point are dropped
+    double interval_ns;           // gap between two intended start times
+};
+
+struct WorkerResult {
+    LatencyHistogram histogram;
+    size_t reads = 0;
+    size_t writes = 0;
+    size_t dropped = 0;
+    size_t errors = 0;
+    Clock::time_point last_done;
+};
+
+uint64_t to_ns(Clock::duration d) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+// Sleep until shortly before `when`, then spin, so the operation starts on time
+void wait_until(Clock::time_point when) {
+    constexpr auto spin = std::chrono::microseconds(100);
+    if (when - Clock::now() > spin) {
+        std::this_thread::sleep_until(when - spin);
+    }
+    while (Clock::now() < when) {
+    }
+}
+
+void worker(int fd, int id, size_t file_size, const OpenLoopOptions& opts,
+            const Schedule& schedule, std::atomic<uint64_t>& next_op, WorkerResult& result) {
+    size_t max_size = 0;
+    std::vector<double> weights;
+    for (const auto& s : opts.sizes) {
+        max_size = std::max(max_size, s.first);
+        weights.push_back(s.second);
+    }
+    void* buf_ptr = nullptr;
+    if (posix_memalign(&buf_ptr, DIRECT_ALIGNMENT, max_size) != 0) {
+        std::cerr << "Worker " << id << ": Memory allocation failed.\n";
+        return;
+    }
+    std::memset(buf_ptr, 'O', max_size);
+
+    std::mt19937_64 rng(0x9E3779B97F4A7C15ULL * (id + 1));
+    std::discrete_distribution<size_t> size_dist(weights.begin(), weights.end());
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    while (true) {
+        uint64_t op = next_op.fetch_add(1, std::memory_order_relaxed);
+        auto intended = schedule.start +
+            std::chrono::nanoseconds(static_cast<int64_t>(op * schedule.interval_ns));
+        if (intended >= schedule.end) {
+            break;
+        }
+        if (Clock::now() >= schedule.hard_stop) {
+            // Too far behind: never issued, but its latency is at least this long
+            ++result.dropped;
+            result.histogram.record(to_ns(Clock::now() - intended));
+            continue;
+        }
+        wait_until(intended);
+
+        size_t size = opts.sizes[size_dist(rng)].first;
+        off_t offset = static_cast<off_t>(rng() % ((file_size - size) / DIRECT_ALIGNMENT + 1) *
+                                          DIRECT_ALIGNMENT);
+        bool is_read = percent(rng) < opts.read_percent;
+        ssize_t n = is_read ? pread(fd, buf_ptr, size, offset)
+                            : pwrite(fd, buf_ptr, size, offset);
+        auto done = Clock::now();
+        if (n != static_cast<ssize_t>(size)) {
+            ++result.errors;
+        }
+        if (is_read) {
+            ++result.reads;
+        } else {
+            ++result.writes;
+        }
+        // Latency from the intended start, not from the actual issue time,
+        // so the waiting caused by a slow storage is not omitted.
+        result.histogram.record(to_ns(done - intended));
+        result.last_done = std::max(result.last_done, done);
+    }
+    free(buf_ptr);
+}
+
+} // namespace
+
+void run_open_loop_benchmark(const OpenLoopOptions& opts, BenchResults& results) {
+    constexpr double rate_growth = 1.5;
+    constexpr int max_steps = 30;
+
+    size_t file_size = opts.size_mb * MB;
+    for (const auto& s : opts.sizes) {
+        if (s.first == 0 || s.first % DIRECT_ALIGNMENT != 0 || s.first > file_size) {
+            std::cerr << "Operation sizes must be multiples of " << DIRECT_ALIGNMENT
+                      << " bytes and fit in the file\n";
+            return;
+        }
+    }
+
+    std::cout << "Preparing " << opts.size_mb << " MB test file...\n";
+    if (!write_test_file(opts.path, file_size)) {
+        return;
+    }
+    bool direct = false;
+    int fd = open_test_file(opts.path, direct);
+    if (fd < 0) {
+        perror("open");
+        return;
+    }
+    std::cout << "I/O: " << (direct ? "O_DIRECT" : "buffered") << " | Workers: " << opts.workers
+              << " | Reads: " << opts.read_percent << "% | SLO p99: " << opts.slo_p99_us << " us\n";
+
+    double rate = opts.start_rate;
+    double best_rate = 0;
+    for (int step = 0; step < max_steps; ++step, rate *= rate_growth) {
+        auto step_duration = std::chrono::nanoseconds(static_cast<int64_t>(opts.step_seconds * 1e9));
+        Schedule schedule;
+        schedule.start = Clock::now() + std::chrono::milliseconds(10);
+        schedule.end = schedule.start + step_duration;
+        schedule.hard_stop = schedule.end + step_duration;
+        schedule.interval_ns = 1e9 / rate;
+
+        std::atomic<uint64_t> next_op{0};
+        std::vector<WorkerResult> worker_results(opts.workers);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < opts.workers; ++i) {
+            threads.emplace_back(worker, fd, i, file_size, std::cref(opts), std::cref(schedule),
+                                 std::ref(next_op), std::ref(worker_results[i]));
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        WorkerResult total;
+        total.last_done = schedule.start;
+        for (const WorkerResult& r : worker_results) {
+            total.histogram.merge(r.histogram);
+            total.reads += r.reads;
+            total.writes += r.writes;
+            total.dropped += r.dropped;
+            total.errors += r.errors;
+            total.last_done = std::max(total.last_done, r.last_done);
+        }
+        double elapsed = std::chrono::duration<double>(total.last_done - schedule.start).count();
+        size_t completed = total.reads + total.writes;
+        double p99_us = total.histogram.value_at_percentile(99) / 1e3;
+        // A step that completed nothing has no latency to judge
+        bool slo_ok = completed > 0 && p99_us <= opts.slo_p99_us && total.dropped == 0;
+
+        std::cout << "Offered: " << rate << " ops/s | "
+                  << "Achieved: " << (elapsed > 0 ? completed / elapsed : 0) << " ops/s | "
+                  << "p50: " << total.histogram.value_at_percentile(50) / 1e3 << " us | "
+                  << "p90: " << total.histogram.value_at_percentile(90) / 1e3 << " us | "
+                  << "p99: " << p99_us << " us | "
+                  << "p99.9: " << total.histogram.value_at_percentile(99.9) / 1e3 << " us | "
+                  << "max: " << total.histogram.max() / 1e3 << " us";
+        if (total.dropped > 0) {
+            std::cout << " | dropped: " << total.dropped;
+        }
+        if (total.errors > 0) {
+            std::cout << " | errors: " << total.errors;
+        }
+        std::cout << (slo_ok ? "" : " | SLO broken") << "\n";
+
+        auto add = [&](const std::string& metric, double value, const std::string& unit) {
+            results.add("step", metric, value, unit)
+                .param("offered", rate).param("read_percent", opts.read_percent);
+        };
+        add("achieved", elapsed > 0 ? completed / elapsed : 0, "ops/s");
+        add("p50", total.histogram.value_at_percentile(50) / 1e3, "us");
+        add("p99", p99_us, "us");
+
+        if (!slo_ok) {
+            break;
+        }
+        best_rate = rate;
+    }
+
+    std::cout << "Highest offered load within SLO: " << best_rate << " ops/s\n";
+    results.add("slo", "max_offered", best_rate, "ops/s")
+        .param("slo_p99_us", opts.slo_p99_us).param("read_percent", opts.read_percent);
+    close(fd);
+    unlink(opts.path.c_str());
+}
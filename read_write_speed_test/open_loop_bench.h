@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+class BenchResults;
+
+struct OpenLoopOptions {
+    std::string path;                  // test file
+    size_t size_mb = 1024;             // size of the test file
+    double start_rate = 1000;          // offered load of the first step, ops/s
+    int read_percent = 70;             // share of reads among the operations
+    // Operation sizes and their weights
+    std::vector<std::pair<size_t, double>> sizes = {{4096, 1.0}};
+    double step_seconds = 5;           // duration of one load step
+    double slo_p99_us = 10000;         // p99 latency objective
+    int workers = 16;                  // threads issuing the operations
+};
+
+// Issue random reads and writes at a fixed offered rate regardless of how
+// fast the previous operations complete (open loop), measuring latency from
+// the intended start time of every operation. The offered load grows step by
+// step until the p99 latency breaks the objective.
+void run_open_loop_benchmark(const OpenLoopOptions& opts, BenchResults& results);
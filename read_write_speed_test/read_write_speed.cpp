@@ -5,15 +5,207 @@
 #include <sys/stat.h>
 #include <cstring>
 #include <iostream>
+#include <string>
 #include <vector>
 
-double get_time_sec() {
-    timeval tv;
-    gettimeofday(&tv, nullptr);
-    return tv.tv_sec + tv.tv_usec / 1e6;
+#include "rw_common.h"
+#include "copy_bench.h"
+#include "vectored_bench.h"
+#include "durability_bench.h"
+#include "open_loop_bench.h"
+#include "aio_bench.h"
+#include "bench_results.h"
+
+struct Options {
+    std::string mode = "rw";
+    std::string path = "/tmp/ssd_benchmark_test.dat";
+    std::string input;      // copy source; generated when empty
+    size_t size_mb = 0;     // size of generated files, 0 - default of the mode
+    size_t record_size = 4096;
+    int iov_count = 64;
+    std::vector<size_t> commit_sizes = {4096};
+    OpenLoopOptions open_loop;
+    AioOptions aio;
+    MeasureOptions measure;
+    ResultsOptions results;
+    bool help = false;
+};
+
+void print_help(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [-m=rw|copy|vectored|durability|openloop|aio]\n"
+              << "       [-p=path] [-i=src] [-s=N] [-r=N[KMG]] [-v=N] [-c=N[KMG],...]\n"
+              << "       [-t=N] [-x=N] [-z=N[KMG][:W],...] [-d=N] [-l=N] [-j=N]\n"
+              << "       [-q=N,...] [-b=N]\n"
+              << "       [--warmup=N] [--reps=N] [--keep-outliers] [--timer=monotonic|tsc]\n"
+              << "       [--json=FILE] [--csv=FILE] [--compare=FILE] [--threshold=N] [-h]\n"
+              << "  -m=rw    Sequential write/read of growing files (default)\n"
+              << "  -m=copy  File-to-file copy with read/write, copy_file_range,\n"
+              << "           sendfile, splice and mmap+memcpy\n"
+              << "  -m=vectored  Small records written/read one per syscall vs\n"
+              << "           pwritev/preadv (and RWF_DSYNC/RWF_NOWAIT variants)\n"
+              << "  -m=durability  Commits made durable with fsync/fdatasync/O_DSYNC/\n"
+              << "           O_SYNC/sync_file_range on append/sparse/fallocate/overwrite files\n"
+              << "  -m=openloop  Random reads/writes issued at a fixed rate, latency from the\n"
+              << "           intended start; the rate grows x1.5 per step until p99 breaks the SLO\n"
+              << "  -m=aio   Random O_DIRECT reads/writes with Linux native AIO (io_submit)\n"
+              << "           vs a pread/pwrite thread pool at the same queue depth\n"
+              << "  -p=path  Test file (copy destination), default /tmp/ssd_benchmark_test.dat\n"
+              << "  -i=src   Copy source file; a file of -s MB is generated when omitted\n"
+              << "  -s=N     Size of the generated file in MB (default: 1024, 64 for durability;\n"
+              << "           -m=rw runs 100 MB to 12 GB files unless set)\n"
+              << "  -r=N[KMG] Record size for -m=vectored, block size for -m=aio (default: 4K)\n"
+              << "  -v=N     Records per vectored call (default: 64)\n"
+              << "  -c=N[KMG],...  Commit sizes for -m=durability (default: 4K)\n"
+              << "  -t=N     Offered load of the first -m=openloop step, ops/s (default: 1000)\n"
+              << "  -x=N     Percentage of reads for -m=openloop (default: 70)\n"
+              << "  -z=N[KMG][:W],...  Operation sizes with weights (default: 4K)\n"
+              << "  -d=N     Duration of one load step in seconds (default: 5)\n"
+              << "  -l=N     p99 latency objective in microseconds (default: 10000)\n"
+              << "  -j=N     Number of threads issuing operations (default: 16)\n"
+              << "  -q=N,... Queue depths (outstanding I/Os) for -m=aio (default: 32)\n"
+              << "  -b=N     iocbs per io_submit call for -m=aio (default: 8)\n"
+              << "  -h       Show this help message\n";
+    print_measure_help();
+    print_results_help();
 }
 
-void benchmark(int size_mb, const char* path) {
+Options parse_args(int argc, char* argv[]) {
+    Options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "-h") {
+            opts.help = true;
+        } else if (arg.rfind("-m=", 0) == 0) {
+            opts.mode = arg.substr(3);
+            if (opts.mode != "rw" && opts.mode != "copy" && opts.mode != "vectored" &&
+                opts.mode != "durability" && opts.mode != "openloop" && opts.mode != "aio") {
+                std::cerr << "Invalid value for -m: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-p=", 0) == 0) {
+            opts.path = arg.substr(3);
+        } else if (arg.rfind("-i=", 0) == 0) {
+            opts.input = arg.substr(3);
+        } else if (arg.rfind("-s=", 0) == 0) {
+            opts.size_mb = std::stoul(arg.substr(3));
+        } else if (arg.rfind("-r=", 0) == 0) {
+            try {
+                opts.record_size = parse_size(arg.substr(3));
+                if (opts.record_size == 0) {
+                    throw std::invalid_argument("zero record size");
+                }
+            }
+            catch(...) {
+                std::cerr << "Invalid record size: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-v=", 0) == 0) {
+            opts.iov_count = std::stoi(arg.substr(3));
+        } else if (arg.rfind("-t=", 0) == 0) {
+            opts.open_loop.start_rate = std::stod(arg.substr(3));
+            if (!(opts.open_loop.start_rate > 0)) {
+                std::cerr << "Invalid value for -t: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-x=", 0) == 0) {
+            opts.open_loop.read_percent = std::stoi(arg.substr(3));
+            if (opts.open_loop.read_percent < 0 || opts.open_loop.read_percent > 100) {
+                std::cerr << "Invalid value for -x: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-z=", 0) == 0) {
+            opts.open_loop.sizes.clear();
+            std::string list = arg.substr(3);
+            for (size_t pos = 0; pos <= list.size();) {
+                size_t comma = std::min(list.find(',', pos), list.size());
+                std::string item = list.substr(pos, comma - pos);
+                size_t colon = item.find(':');
+                try {
+                    double weight = colon == std::string::npos ? 1.0 : std::stod(item.substr(colon + 1));
+                    if (!(weight > 0)) {
+                        throw std::invalid_argument("weight must be positive");
+                    }
+                    opts.open_loop.sizes.push_back({parse_size(item.substr(0, colon)), weight});
+                }
+                catch(...) {
+                    std::cerr << "Invalid size distribution: " << arg << "\n";
+                    opts.help = true;
+                    break;
+                }
+                pos = comma + 1;
+            }
+        } else if (arg.rfind("-d=", 0) == 0) {
+            opts.open_loop.step_seconds = std::stod(arg.substr(3));
+            if (!(opts.open_loop.step_seconds > 0)) {
+                std::cerr << "Invalid value for -d: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-l=", 0) == 0) {
+            opts.open_loop.slo_p99_us = std::stod(arg.substr(3));
+            if (!(opts.open_loop.slo_p99_us > 0)) {
+                std::cerr << "Invalid value for -l: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-j=", 0) == 0) {
+            opts.open_loop.workers = std::stoi(arg.substr(3));
+            if (opts.open_loop.workers <= 0) {
+                std::cerr << "Invalid value for -j: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-q=", 0) == 0) {
+            opts.aio.queue_depths.clear();
+            std::string list = arg.substr(3);
+            for (size_t pos = 0; pos <= list.size();) {
+                size_t comma = std::min(list.find(',', pos), list.size());
+                try {
+                    opts.aio.queue_depths.push_back(std::stoi(list.substr(pos, comma - pos)));
+                    if (opts.aio.queue_depths.back() < 1) {
+                        throw std::invalid_argument("queue depth below one");
+                    }
+                }
+                catch(...) {
+                    std::cerr << "Invalid queue depth: " << arg << "\n";
+                    opts.help = true;
+                    break;
+                }
+                pos = comma + 1;
+            }
+        } else if (arg.rfind("-b=", 0) == 0) {
+            opts.aio.batch = std::stoi(arg.substr(3));
+            if (opts.aio.batch < 1) {
+                std::cerr << "Invalid value for -b: " << arg << "\n";
+                opts.help = true;
+            }
+        } else if (arg.rfind("-c=", 0) == 0) {
+            opts.commit_sizes.clear();
+            std::string list = arg.substr(3);
+            for (size_t pos = 0; pos <= list.size();) {
+                size_t comma = std::min(list.find(',', pos), list.size());
+                try {
+                    opts.commit_sizes.push_back(parse_size(list.substr(pos, comma - pos)));
+                }
+                catch(...) {
+                    std::cerr << "Invalid commit size: " << arg << "\n";
+                    opts.help = true;
+                    break;
+                }
+                pos = comma + 1;
+            }
+        } else if (parse_measure_arg(arg, opts.measure)) {
+        } else if (parse_results_arg(arg, opts.results)) {
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            opts.help = true;
+        }
+    }
+
+    return opts;
+}
+
+// One sequential write and read of the file; speeds in MB/s
+bool write_read_once(int size_mb, const char* path, double& write_speed, double& read_speed) {
     const size_t block_size = 1024 * 1024;
     size_t total_size = size_mb * block_size;
     std::vector<char> buffer(block_size, 'A');
@@ -22,62 +214,125 @@ void benchmark(int size_mb, const char* path) {
     int fd = open(path, O_CREAT | O_WRONLY, 0666);
     if (fd < 0) {
         perror("open write");
-        return;
+        return false;
     }
 
     // Disable caching on macOS
-    fcntl(fd, F_NOCACHE, 1);
+    set_nocache(fd);
 
-    double write_start = get_time_sec();
+    double write_start = bench_now();
     for (size_t written = 0; written < total_size; written += block_size) {
         if (write(fd, buffer.data(), block_size) != block_size) {
             perror("write");
             close(fd);
-            return;
+            return false;
         }
     }
     fsync(fd);
-    double write_end = get_time_sec();
+    double write_end = bench_now();
     close(fd);
 
-    double write_speed = size_mb / (write_end - write_start);
+    write_speed = size_mb / (write_end - write_start);
 
     // ==== Read ====
     fd = open(path, O_RDONLY);
     if (fd < 0) {
         perror("open read");
-        return;
+        return false;
     }
 
-    fcntl(fd, F_NOCACHE, 1);
+    set_nocache(fd);
 
-    double read_start = get_time_sec();
+    double read_start = bench_now();
     for (size_t read_bytes = 0; read_bytes < total_size; read_bytes += block_size) {
         if (read(fd, buffer.data(), block_size) != block_size) {
             perror("read");
             close(fd);
-            return;
+            return false;
         }
     }
-    double read_end = get_time_sec();
+    double read_end = bench_now();
     close(fd);
 
-    double read_speed = size_mb / (read_end - read_start);
+    read_speed = size_mb / (read_end - read_start);
+    return true;
+}
+
+void benchmark(int size_mb, const char* path, const MeasureOptions& measure_opts,
+               BenchResults& results) {
+    std::vector<double> write_speeds, read_speeds;
+    bool ok = measure(measure_opts, [&](bool measured) {
+        double write_speed = 0, read_speed = 0;
+        if (!write_read_once(size_mb, path, write_speed, read_speed)) {
+            return false;
+        }
+        if (measured) {
+            write_speeds.push_back(write_speed);
+            read_speeds.push_back(read_speed);
+        }
+        return true;
+    });
+    if (!ok) {
+        return;
+    }
+    Summary write_speed = summarize(write_speeds, measure_opts.reject_outliers);
+    Summary read_speed = summarize(read_speeds, measure_opts.reject_outliers);
 
     // ==== Output ====
     std::cout << "Size: " << size_mb << " MB | "
               << "Write: " << write_speed << " MB/s | "
               << "Read: " << read_speed << " MB/s\n";
+    results.add("sequential", "write", write_speed, "MB/s").param("size_mb", size_mb);
+    results.add("sequential", "read", read_speed, "MB/s").param("size_mb", size_mb);
 }
 
-int main() {
-    const char* path = "/tmp/ssd_benchmark_test.dat";
-    std::vector<int> sizes_mb = {100, 512, 1024, 2048, 4096, 8192, 12288};
+int main(int argc, char* argv[]) {
+    Options options = parse_args(argc, argv);
+
+    if (options.help) {
+        print_help(argv[0]);
+        return 0;
+    }
+
+    init_timer(options.measure);
+    BenchResults results("read_write_speed/" + options.mode);
+    results.set_path(options.path);
+
+    if (options.mode == "copy") {
+        run_copy_benchmark({options.input, options.path,
+                            options.size_mb ? options.size_mb : 1024}, options.measure, results);
+    } else if (options.mode == "vectored") {
+        run_vectored_benchmark({options.path, options.size_mb ? options.size_mb : 1024,
+                                options.record_size, options.iov_count}, options.measure, results);
+    } else if (options.mode == "durability") {
+        run_durability_benchmark({options.path, options.size_mb ? options.size_mb : 64,
+                                  options.commit_sizes}, options.measure, results);
+    } else if (options.mode == "openloop") {
+        OpenLoopOptions open_loop = options.open_loop;
+        open_loop.path = options.path;
+        open_loop.size_mb = options.size_mb ? options.size_mb : 1024;
+        run_open_loop_benchmark(open_loop, results);
+    } else if (options.mode == "aio") {
+        AioOptions aio = options.aio;
+        aio.path = options.path;
+        aio.size_mb = options.size_mb ? options.size_mb : 1024;
+        aio.block_size = options.record_size;
+        if (!run_aio_benchmark(aio, options.measure, results)) {
+            return 1;
+        }
+    } else {
+        const char* path = options.path.c_str();
+        std::vector<int> sizes_mb = {100, 512, 1024, 2048, 4096, 8192, 12288};
+        if (options.size_mb) {
+            sizes_mb = {static_cast<int>(options.size_mb)};
+        }
+
+        for (int size : sizes_mb) {
+            benchmark(size, path, options.measure, results);
+        }
 
-    for (int size : sizes_mb) {
-        benchmark(size, path);
+        unlink(path); // Clean up
     }
 
-    unlink(path); // Clean up
-    return 0;
+    return finish_results(results, options.results);
 }
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "bench_timer.h"
+#include "parse_size.h"
+
+constexpr size_t MB = 1024 * 1024;
+
+// Disable (or drop) the page cache for a file.
+// macOS has F_NOCACHE; on Linux the closest unprivileged thing is to drop
+// the clean cached pages of the file.
+inline void set_nocache(int fd) {
+#ifdef F_NOCACHE
+    fcntl(fd, F_NOCACHE, 1);
+#elif defined(POSIX_FADV_DONTNEED)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#else
+    (void)fd;
+#endif
+}
+
+// User and system CPU time of the process, in seconds
+struct CpuTimes {
+    double user = 0.0;
+    double sys = 0.0;
+};
+
+inline CpuTimes get_cpu_times() {
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    CpuTimes t;
+    t.user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    t.sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    return t;
+}
+
+// Create (or overwrite) a file of the given size filled with a pattern
+// and flush it to the disk.
+inline bool write_test_file(const std::string& path, size_t size) {
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror("open test file");
+        return false;
+    }
+    std::vector<char> buffer(MB);
+    for (size_t i = 0; i < buffer.size(); ++i) buffer[i] = static_cast<char>(i % 251);
+    for (size_t written = 0; written < size;) {
+        size_t chunk = std::min(buffer.size(), size - written);
+        ssize_t n = write(fd, buffer.data(), chunk);
+        if (n <= 0) {
+            perror("write test file");
+            close(fd);
+            return false;
+        }
+        written += n;
+    }
+    if (fsync(fd) != 0) {
+        perror("fsync test file");
+        close(fd);
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+// Buffer, offset and size alignment that works for O_DIRECT on common devices
+constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+// Open the test file for reading and writing with O_DIRECT where the
+// filesystem supports it, otherwise buffered with the cache dropped.
+inline int open_test_file(const std::string& path, bool& direct) {
+    direct = false;
+    int fd = -1;
+#ifdef O_DIRECT
+    fd = open(path.c_str(), O_RDWR | O_DIRECT);
+    if (fd >= 0) {
+        direct = true;
+        return fd;
+    }
+#endif
+    fd = open(path.c_str(), O_RDWR);
+    if (fd >= 0) {
+        set_nocache(fd);
+    }
+    return fd;
+}
@@ -0,0 +1,281 @@
+#include "vectored_bench.h"
+#include "rw_common.h"
+#include "bench_results.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+struct PassResult {
+    bool ok = true;
+    int err = 0;
+    double seconds = 0.0;
+    size_t syscalls = 0;
+    size_t fallbacks = 0;  // RWF_NOWAIT calls that would block (EAGAIN or short) and were finished blocking
+};
+
+// Transfers iov[0..count) at `offset`; returns the number of bytes or -1.
+using IoCall = std::function<ssize_t(int fd, const iovec* iov, int count, off_t offset,
+                                     PassResult& result)>;
+
+struct Variant {
+    std::string name;
+    int per_call;  // records per syscall
+    IoCall call;
+};
+
+// Transfers what a RWF_NOWAIT call left of iov[0..count) with blocking calls.
+// `done` bytes were already transferred; returns the total or -1.
+ssize_t finish_blocking(int fd, const iovec* iov, int count, off_t offset, ssize_t done,
+                        bool is_write) {
+    std::vector<iovec> rest(iov, iov + count);
+    size_t first = 0;
+    size_t skip = static_cast<size_t>(done);
+    while (first < rest.size() && skip >= rest[first].iov_len) {
+        skip -= rest[first].iov_len;
+        ++first;
+    }
+    ssize_t total = done;
+    while (first < rest.size()) {
+        rest[first].iov_base = static_cast<char*>(rest[first].iov_base) + skip;
+        rest[first].iov_len -= skip;
+        int left = static_cast<int>(rest.size() - first);
+        ssize_t n = is_write ? pwritev(fd, rest.data() + first, left, offset + total)
+                             : preadv(fd, rest.data() + first, left, offset + total);
+        if (n <= 0) {
+            return n < 0 ? -1 : total;
+        }
+        total += n;
+        skip = static_cast<size_t>(n);
+        while (first < rest.size() && skip >= rest[first].iov_len) {
+            skip -= rest[first].iov_len;
+            ++first;
+        }
+    }
+    return total;
+}
+
+size_t total_length(const iovec* iov, int count) {
+    size_t length = 0;
+    for (int i = 0; i < count; ++i) {
+        length += iov[i].iov_len;
+    }
+    return length;
+}
+
+PassResult run_pass(int fd, const std::vector<iovec>& iov, size_t total_records,
+                    const Variant& variant) {
+    PassResult result;
+    size_t record_size = iov[0].iov_len;
+    double start = bench_now();
+    for (size_t record = 0; record < total_records;) {
+        int count = static_cast<int>(
+            std::min<size_t>(variant.per_call, total_records - record));
+        ssize_t expected = static_cast<ssize_t>(count * record_size);
+        ssize_t n = variant.call(fd, iov.data(), count, record * record_size, result);
+        ++result.syscalls;
+        if (n != expected) {
+            result.ok = false;
+            result.err = n < 0 ? errno : EIO;
+            break;
+        }
+        record += count;
+    }
+    result.seconds = bench_now() - start;
+    return result;
+}
+
+// Run one variant with the warm-up and repetitions and print its summary.
+// `pass` transfers the whole file once.
+void run_variant(const std::string& direction, const Variant& variant, size_t bytes,
+                 size_t record_size, const MeasureOptions& measure_opts, BenchResults& results,
+                 const std::function<PassResult()>& pass) {
+    std::vector<double> calls, speeds;
+    size_t fallbacks = 0;
+    PassResult failed;
+    measure(measure_opts, [&](bool measured) {
+        PassResult result = pass();
+        if (!result.ok) {
+            failed = result;
+            return false;
+        }
+        if (measured) {
+            calls.push_back(result.syscalls / result.seconds);
+            speeds.push_back((bytes / static_cast<double>(MB)) / result.seconds);
+            fallbacks += result.fallbacks;
+        }
+        return true;
+    });
+
+    std::cout << direction << ": " << variant.name << " | ";
+    if (!failed.ok) {
+        bool unsupported = failed.err == EOPNOTSUPP || failed.err == EINVAL ||
+                           failed.err == ENOSYS;
+        std::cout << (unsupported ? "unsupported: " : "failed: ")
+                  << std::strerror(failed.err) << "\n";
+        return;
+    }
+    Summary call_rate = summarize(calls, measure_opts.reject_outliers);
+    Summary speed = summarize(speeds, measure_opts.reject_outliers);
+    std::cout << "Calls: " << call_rate << "/s | "
+              << "Throughput: " << speed << " MB/s";
+    std::string name = direction == "Write" ? "write" : "read";
+    results.add(name, "syscalls", call_rate, "calls/s")
+        .param("variant", variant.name).param("record_size", record_size);
+    results.add(name, "throughput", speed, "MB/s")
+        .param("variant", variant.name).param("record_size", record_size);
+    if (fallbacks > 0) {
+        std::cout << " | NOWAIT fallbacks: " << fallbacks;
+    }
+    std::cout << "\n";
+}
+
+std::vector<Variant> write_variants(int iov_count) {
+    std::string v = " x" + std::to_string(iov_count);
+    std::vector<Variant> variants = {
+        {"pwrite x1", 1, [](int fd, const iovec* iov, int, off_t offset, PassResult&) {
+            return pwrite(fd, iov[0].iov_base, iov[0].iov_len, offset);
+        }},
+        {"pwritev" + v, iov_count, [](int fd, const iovec* iov, int count, off_t offset,
+                                      PassResult&) {
+            return pwritev(fd, iov, count, offset);
+        }},
+    };
+#ifdef RWF_DSYNC
+    variants.push_back({"pwritev2 RWF_DSYNC" + v, iov_count,
+        [](int fd, const iovec* iov, int count, off_t offset, PassResult&) {
+            return pwritev2(fd, iov, count, offset, RWF_DSYNC);
+        }});
+#endif
+#ifdef RWF_NOWAIT
+    variants.push_back({"pwritev2 RWF_NOWAIT" + v, iov_count,
+        [](int fd, const iovec* iov, int count, off_t offset, PassResult& result) {
+            ssize_t n = pwritev2(fd, iov, count, offset, RWF_NOWAIT);
+            if (n < 0 && errno == EAGAIN) {
+                n = 0;
+            }
+            // A partial transfer is legal with RWF_NOWAIT: the rest would block
+            if (n >= 0 && static_cast<size_t>(n) < total_length(iov, count)) {
+                ++result.fallbacks;
+                ++result.syscalls;
+                n = finish_blocking(fd, iov, count, offset, n, true);
+            }
+            return n;
+        }});
+#endif
+    return variants;
+}
+
+std::vector<Variant> read_variants(int iov_count) {
+    std::string v = " x" + std::to_string(iov_count);
+    std::vector<Variant> variants = {
+        {"pread x1", 1, [](int fd, const iovec* iov, int, off_t offset, PassResult&) {
+            return pread(fd, iov[0].iov_base, iov[0].iov_len, offset);
+        }},
+        {"preadv" + v, iov_count, [](int fd, const iovec* iov, int count, off_t offset,
+                                     PassResult&) {
+            return preadv(fd, iov, count, offset);
+        }},
+    };
+#ifdef RWF_NOWAIT
+    variants.push_back({"preadv2 RWF_NOWAIT" + v, iov_count,
+        [](int fd, const iovec* iov, int count, off_t offset, PassResult& result) {
+            ssize_t n = preadv2(fd, iov, count, offset, RWF_NOWAIT);
+            if (n < 0 && errno == EAGAIN) {
+                n = 0;
+            }
+            // A partial transfer is legal with RWF_NOWAIT: the rest would block
+            if (n >= 0 && static_cast<size_t>(n) < total_length(iov, count)) {
+                ++result.fallbacks;
+                ++result.syscalls;
+                n = finish_blocking(fd, iov, count, offset, n, false);
+            }
+            return n;
+        }});
+#endif
+    return variants;
+}
+
+} // namespace
+
+void run_vectored_benchmark(const VectoredOptions& opts, const MeasureOptions& measure_opts,
+                            BenchResults& results) {
+    int iov_count = std::max(1, std::min(opts.iov_count, IOV_MAX));
+    size_t record_size = opts.record_size;
+    if (record_size == 0) {
+        std::cerr << "The record size must be at least 1 byte\n";
+        return;
+    }
+    size_t total_records = opts.size_mb * MB / record_size;
+    size_t total_bytes = total_records * record_size;
+    if (total_records == 0) {
+        std::cerr << "Record size is larger than the test size\n";
+        return;
+    }
+
+    // Every record of one call lives in its own buffer, as when a log writer
+    // gathers records that were produced in different places.
+    std::vector<std::vector<char>> records(iov_count);
+    std::vector<iovec> iov(iov_count);
+    for (int i = 0; i < iov_count; ++i) {
+        records[i].assign(record_size, static_cast<char>('A' + i % 26));
+        iov[i].iov_base = records[i].data();
+        iov[i].iov_len = record_size;
+    }
+
+    std::cout << "Records: " << total_records << " x " << record_size << " bytes, "
+              << iov_count << " records per vectored call\n";
+
+    for (const Variant& variant : write_variants(iov_count)) {
+        run_variant("Write", variant, total_bytes, record_size, measure_opts, results, [&]() {
+            PassResult result;
+            int fd = open(opts.path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0666);
+            if (fd < 0) {
+                result.ok = false;
+                result.err = errno;
+                return result;
+            }
+            set_nocache(fd);
+            double start = bench_now();
+            result = run_pass(fd, iov, total_records, variant);
+            if (result.ok && fsync(fd) != 0) {
+                result.ok = false;
+                result.err = errno;
+            }
+            result.seconds = bench_now() - start;
+            close(fd);
+            return result;
+        });
+    }
+
+    // The last write variant may have failed; make sure there is a full file to read
+    if (!write_test_file(opts.path, total_bytes)) {
+        return;
+    }
+
+    for (const Variant& variant : read_variants(iov_count)) {
+        run_variant("Read ", variant, total_bytes, record_size, measure_opts, results, [&]() {
+            PassResult result;
+            int fd = open(opts.path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                result.ok = false;
+                result.err = errno;
+                return result;
+            }
+            set_nocache(fd);
+            result = run_pass(fd, iov, total_records, variant);
+            close(fd);
+            return result;
+        });
+    }
+
+    unlink(opts.path.c_str());
+}
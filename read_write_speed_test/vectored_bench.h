@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class BenchResults;
+struct MeasureOptions;
+
+struct VectoredOptions {
+    std::string path;            // test file
+    size_t size_mb = 1024;       // total amount of data to write and read
+    size_t record_size = 4096;   // size of one record
+    int iov_count = 64;          // records per pwritev/preadv call
+};
+
+// Write and read a file as many small records: one pwrite/pread per record
+// against pwritev/preadv (and pwritev2/preadv2 with RWF_DSYNC/RWF_NOWAIT
+// where available) and print syscalls/s and throughput for each variant.
+void run_vectored_benchmark(const VectoredOptions& opts, const MeasureOptions& measure_opts,
+                            BenchResults& results);